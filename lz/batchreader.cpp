@@ -0,0 +1,494 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+
+#include "batchreader.h"
+#include "linestore.h"
+
+namespace batchreader {
+
+/**
+ * The submission and completion queues of an io_uring instance.
+ *
+ * This is only what `read_files_uring` needs, written against the
+ * raw system calls so that liburing is not required.
+*/
+class Ring {
+
+    public:
+        /**
+         * @param entries minimum number of submission queue entries.
+        */
+        explicit Ring(unsigned int entries) {
+            auto params = io_uring_params();
+            fd = syscall(__NR_io_uring_setup, entries, &params);
+            if (fd < 0) {
+                return;
+            }
+
+            sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+            cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+            if (single_mmap) {
+                sq_size = cq_size = std::max(sq_size, cq_size);
+            }
+            sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+            sq_ptr = mmap(0, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+            cq_ptr = single_mmap ? sq_ptr : mmap(0, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            auto sqes_ptr = mmap(0, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+            if ((sq_ptr == MAP_FAILED) || (cq_ptr == MAP_FAILED) || (sqes_ptr == MAP_FAILED)) {
+                unmap(sqes_ptr);
+                close(fd);
+                fd = -1;
+                return;
+            }
+
+            auto sq = static_cast<char*>(sq_ptr);
+            sq_head = reinterpret_cast<unsigned int*>(sq + params.sq_off.head);
+            sq_tail = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+            sq_mask = *reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+            sq_array = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+            sq_entries = params.sq_entries;
+            sqes = static_cast<io_uring_sqe*>(sqes_ptr);
+
+            auto cq = static_cast<char*>(cq_ptr);
+            cq_head = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+            cq_tail = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+            cq_mask = *reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+            cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+            local_tail = *sq_tail;
+        }
+
+        ~Ring() {
+            if (fd < 0) {
+                return;
+            }
+            unmap(sqes);
+            close(fd);
+        }
+
+        Ring(const Ring&) = delete;
+        auto operator=(const Ring&) -> Ring& = delete;
+
+        /**
+         * @return true if the ring was set up.
+        */
+        auto ok() const -> bool { return fd >= 0; }
+
+        /**
+         * Register buffers that `IORING_OP_READ_FIXED` can read into.
+         *
+         * @return true on success.
+        */
+        auto register_buffers(const std::vector<iovec>& iovecs) -> bool {
+            return syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, iovecs.data(), iovecs.size()) == 0;
+        }
+
+        /**
+         * Get a zeroed submission queue entry to fill.
+         *
+         * @return the entry, or nullptr if the queue is full.
+        */
+        auto get_sqe() -> io_uring_sqe* {
+            auto head = std::atomic_ref<unsigned int>(*sq_head).load(std::memory_order_acquire);
+            if ((local_tail - head) >= sq_entries) {
+                return nullptr;
+            }
+            auto idx = local_tail & sq_mask;
+            sq_array[idx] = idx;
+            ++local_tail;
+            ++n_unsubmitted;
+            auto sqe = &sqes[idx];
+            memset(sqe, 0, sizeof(*sqe));
+            return sqe;
+        }
+
+        /**
+         * Submit all filled entries and wait for at least one
+         * completion.
+         *
+         * @return false on error.
+        */
+        auto submit_and_wait() -> bool {
+            std::atomic_ref<unsigned int>(*sq_tail).store(local_tail, std::memory_order_release);
+            while (true) {
+                int n = syscall(__NR_io_uring_enter, fd, n_unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+                if (n >= 0) {
+                    n_unsubmitted -= n;
+                    return true;
+                }
+                if (errno != EINTR) {
+                    return false;
+                }
+            }
+        }
+
+        /**
+         * Call `f` on every available completion and consume them.
+        */
+        template<typename F>
+        auto reap(F f) -> void {
+            auto head = *cq_head;
+            auto tail = std::atomic_ref<unsigned int>(*cq_tail).load(std::memory_order_acquire);
+            for (; head != tail; ++head) {
+                f(cqes[head & cq_mask]);
+            }
+            std::atomic_ref<unsigned int>(*cq_head).store(head, std::memory_order_release);
+        }
+
+    private:
+        /**
+         * Unmap the rings and `sqes_ptr`, ignoring anything that
+         * failed to map.
+        */
+        auto unmap(void* sqes_ptr) -> void {
+            if ((sqes_ptr != nullptr) && (sqes_ptr != MAP_FAILED)) {
+                munmap(sqes_ptr, sqes_size);
+            }
+            if ((cq_ptr != nullptr) && (cq_ptr != MAP_FAILED) && !single_mmap) {
+                munmap(cq_ptr, cq_size);
+            }
+            if ((sq_ptr != nullptr) && (sq_ptr != MAP_FAILED)) {
+                munmap(sq_ptr, sq_size);
+            }
+        }
+
+        int fd = -1;
+        bool single_mmap = false;
+        void* sq_ptr = nullptr;
+        void* cq_ptr = nullptr;
+        std::size_t sq_size = 0;
+        std::size_t cq_size = 0;
+        std::size_t sqes_size = 0;
+        unsigned int* sq_head = nullptr;
+        unsigned int* sq_tail = nullptr;
+        unsigned int* sq_array = nullptr;
+        unsigned int sq_mask = 0;
+        unsigned int sq_entries = 0;
+        io_uring_sqe* sqes = nullptr;
+        unsigned int* cq_head = nullptr;
+        unsigned int* cq_tail = nullptr;
+        unsigned int cq_mask = 0;
+        io_uring_cqe* cqes = nullptr;
+        unsigned int local_tail = 0;
+        unsigned int n_unsubmitted = 0;
+};
+
+/**
+ * Requests queued for a file.  These are stored in the low bits of
+ * the user data of each request, next to the index of the slot.
+*/
+enum class Op : std::uint64_t {
+    STATX = 0,
+    OPEN = 1,
+    READ = 2,
+    CLOSE = 3,
+};
+
+/**
+ * State of a file being read by `read_files_uring`.
+ *
+ *   idx: index of the file.
+ *   active: whether the file is being read (it hasn't been handed to
+ *          the callback or skipped yet).
+ *   fd: file descriptor, or -1 if not open.
+ *   n_pending: number of requests in flight.
+ *   failed: whether any request failed.
+ *   has_stat: whether `stx` is filled.
+ *   direct: whether the read in flight goes straight into `text`
+ *          instead of the registered buffer.
+ *   stx: size and modification time of the file.
+ *   text: contents read so far.
+ *   n_read: number of bytes read so far.
+*/
+struct Slot {
+    std::size_t idx;
+    bool active;
+    int fd;
+    int n_pending;
+    bool failed;
+    bool has_stat;
+    bool direct;
+    struct statx stx;
+    std::vector<char> text;
+    std::size_t n_read;
+};
+
+/**
+ * Queue a request on the ring for the file in the `slot_idx`th slot.
+ *
+ * The ring is submitted to and waited on if it is full.
+*/
+auto queue(Ring& ring, std::vector<Slot>& slots, std::size_t slot_idx, Op op) -> io_uring_sqe* {
+    auto sqe = ring.get_sqe();
+    if (sqe == nullptr) {
+        return nullptr;
+    }
+    sqe->user_data = (slot_idx << 2) | static_cast<std::uint64_t>(op);
+    ++slots[slot_idx].n_pending;
+    return sqe;
+}
+
+/**
+ * Queue the next read of the file in the `slot_idx`th slot.
+ *
+ * Files that fit in a registered buffer are read into it.  Larger
+ * files are read straight into their arena with a single request.
+*/
+auto queue_read(Ring& ring, std::vector<Slot>& slots, std::size_t slot_idx, char* buffer) -> bool {
+    auto& slot = slots[slot_idx];
+    auto sqe = queue(ring, slots, slot_idx, Op::READ);
+    if (sqe == nullptr) {
+        return false;
+    }
+    sqe->fd = slot.fd;
+    sqe->off = slot.n_read;
+    slot.direct = slot.has_stat && (slot.stx.stx_size > buffer_size);
+    if (slot.direct) {
+        if (slot.text.size() < (slot.stx.stx_size + 1)) {
+            slot.text.resize(slot.stx.stx_size + 1);
+        }
+        sqe->opcode = IORING_OP_READ;
+        sqe->addr = reinterpret_cast<std::uint64_t>(slot.text.data() + slot.n_read);
+        sqe->len = std::min(slot.text.size() - slot.n_read, std::size_t(1) << 30);
+    }
+    else {
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->addr = reinterpret_cast<std::uint64_t>(buffer);
+        sqe->len = buffer_size;
+        sqe->buf_index = slot_idx;
+    }
+    return true;
+}
+
+/**
+ * Queue the stat and open of the `idx`th file in the `slot_idx`th
+ * slot.
+ *
+ * @return false if the requests couldn't all be queued, in which case
+ *      the slot is marked as failed (so that a request that was
+ *      queued doesn't hand the file to the callback).
+*/
+auto start(Ring& ring, std::vector<Slot>& slots, std::size_t slot_idx, std::size_t idx, const std::string& filename) -> bool {
+    auto& slot = slots[slot_idx];
+    slot.idx = idx;
+    slot.active = true;
+    slot.fd = -1;
+    slot.n_pending = 0;
+    slot.failed = false;
+    slot.has_stat = false;
+    slot.direct = false;
+    slot.text = std::vector<char>();
+    slot.n_read = 0;
+
+    auto sqe = queue(ring, slots, slot_idx, Op::STATX);
+    if (sqe == nullptr) {
+        slot.failed = true;
+        return false;
+    }
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<std::uint64_t>(filename.c_str());
+    sqe->len = STATX_SIZE | STATX_MTIME;
+    sqe->off = reinterpret_cast<std::uint64_t>(&slot.stx);
+
+    sqe = queue(ring, slots, slot_idx, Op::OPEN);
+    if (sqe == nullptr) {
+        slot.failed = true;
+        return false;
+    }
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<std::uint64_t>(filename.c_str());
+    sqe->open_flags = O_RDONLY | O_CLOEXEC;
+    return true;
+}
+
+/**
+ * Hand the file in `slot` to the callback.
+*/
+auto finish(Slot& slot, const std::string& filename, const Callback& callback) -> void {
+    if (slot.failed) {
+        return;
+    }
+    auto lines = std::make_shared<linestore::LineStore>(filename);
+    linestore::load_buffer(std::move(slot.text), slot.n_read, *lines);
+    auto size = slot.has_stat ? static_cast<std::int64_t>(slot.stx.stx_size) : -1;
+    auto mtime = slot.has_stat ? slot.stx.stx_mtime.tv_sec * 1000000000LL + slot.stx.stx_mtime.tv_nsec : -1;
+    callback(File{.idx=slot.idx, .size=size, .mtime=mtime, .lines=lines});
+}
+
+} // namespace batchreader
+
+auto batchreader::read_files(const std::vector<std::string>& filenames, const Callback& callback, const std::atomic<bool>& stop) -> void {
+    const auto unread = read_files_uring(filenames, callback, stop);
+    if (!unread) {
+        read_files_pread(filenames, callback, stop);
+        return;
+    }
+    if (unread->empty()) {
+        return;
+    }
+
+    // The files left after an error are numbered as in `filenames`.
+    auto unread_filenames = std::vector<std::string>();
+    for (const auto idx : *unread) {
+        unread_filenames.push_back(filenames[idx]);
+    }
+    read_files_pread(unread_filenames, [&](File&& file) {
+            file.idx = (*unread)[file.idx];
+            callback(std::move(file));
+            }, stop);
+}
+
+auto batchreader::read_files_uring(const std::vector<std::string>& filenames, const Callback& callback, const std::atomic<bool>& stop) -> std::optional<std::vector<std::size_t>> {
+    auto n_slots = std::min<std::size_t>(max_in_flight, filenames.size());
+    auto buffers = std::vector<char>(n_slots * buffer_size);
+    auto iovecs = std::vector<iovec>(n_slots);
+    for (std::size_t j = 0; j < n_slots; ++j) {
+        iovecs[j] = iovec{.iov_base=buffers.data() + j * buffer_size, .iov_len=buffer_size};
+    }
+    auto slots = std::vector<Slot>(n_slots);
+
+    // The ring is declared after the buffers and slots that its
+    // requests write into, so that it is closed before they are freed.
+    // Each slot has at most two requests in flight (stat and open).
+    auto ring = Ring(2 * max_in_flight);
+    if (!ring.ok()) {
+        return std::nullopt;
+    }
+    if ((n_slots > 0) && !ring.register_buffers(iovecs)) {
+        return std::nullopt;
+    }
+
+    bool ok = true;
+    std::size_t next_file = 0;
+    std::size_t n_active = 0;
+    for (std::size_t j = 0; (j < n_slots) && ok; ++j, ++next_file, ++n_active) {
+        ok = start(ring, slots, j, next_file, filenames[next_file]);
+    }
+
+    while (ok && (n_active > 0)) {
+        if (!ring.submit_and_wait()) {
+            ok = false;
+            break;
+        }
+        ring.reap([&](const io_uring_cqe& cqe) {
+                auto slot_idx = cqe.user_data >> 2;
+                auto op = static_cast<Op>(cqe.user_data & 3);
+                auto& slot = slots[slot_idx];
+                --slot.n_pending;
+
+                if (op == Op::STATX) {
+                    slot.has_stat = cqe.res == 0;
+                }
+                else if (op == Op::OPEN) {
+                    slot.failed = cqe.res < 0;
+                    slot.fd = cqe.res < 0 ? -1 : cqe.res;
+                    ok = slot.failed || queue_read(ring, slots, slot_idx, buffers.data() + slot_idx * buffer_size);
+                }
+                else if (op == Op::READ) {
+                    if (cqe.res > 0) {
+                        if (!slot.direct) {
+                            if (slot.text.size() < (slot.n_read + cqe.res)) {
+                                slot.text.resize(std::max(2 * slot.text.size(), slot.n_read + cqe.res + 1));
+                            }
+                            memcpy(slot.text.data() + slot.n_read, buffers.data() + slot_idx * buffer_size, cqe.res);
+                        }
+                        slot.n_read += cqe.res;
+                    }
+                    slot.failed = cqe.res < 0;
+                    // Files like the ones in /proc report a size of 0, so
+                    // those are read until a read returns nothing.
+                    bool known_size = slot.has_stat && (slot.stx.stx_size > 0);
+                    bool eof = (cqe.res <= 0) || (known_size && (slot.n_read >= slot.stx.stx_size));
+                    if (!eof) {
+                        ok = queue_read(ring, slots, slot_idx, buffers.data() + slot_idx * buffer_size);
+                    }
+                    else if (auto sqe = queue(ring, slots, slot_idx, Op::CLOSE); sqe != nullptr) {
+                        sqe->opcode = IORING_OP_CLOSE;
+                        sqe->fd = slot.fd;
+                        slot.fd = -1;
+                    }
+                    else {
+                        ok = false;
+                    }
+                }
+
+                // After an error, files are no longer handed over, since a
+                // slot that failed to start looks like a file that
+                // couldn't be read.
+                if ((slot.n_pending > 0) || !slot.active || !ok) {
+                    return;
+                }
+                finish(slot, filenames[slot.idx], callback);
+                slot.active = false;
+                if (ok && !stop && (next_file < filenames.size())) {
+                    ok = start(ring, slots, slot_idx, next_file, filenames[next_file]);
+                    ++next_file;
+                }
+                else {
+                    --n_active;
+                }
+                });
+    }
+
+    // After an error, the requests still in flight write into the
+    // slots and buffers, so they are waited for before these are freed.
+    // Their files, and those not started, are left for the caller to
+    // read some other way.
+    const auto has_pending = [&]() { return std::ranges::any_of(slots, [](const auto& slot) { return slot.n_pending > 0; }); };
+    while (has_pending() && ring.submit_and_wait()) {
+        ring.reap([&](const io_uring_cqe& cqe) {
+                auto& slot = slots[cqe.user_data >> 2];
+                --slot.n_pending;
+                if ((static_cast<Op>(cqe.user_data & 3) == Op::OPEN) && (cqe.res >= 0)) {
+                    slot.fd = cqe.res;
+                }
+                });
+    }
+    auto unread = std::vector<std::size_t>();
+    for (const auto& slot : slots) {
+        if (slot.fd >= 0) {
+            close(slot.fd);
+        }
+        if (!ok && slot.active) {
+            unread.push_back(slot.idx);
+        }
+    }
+    if (!ok) {
+        for (; next_file < filenames.size(); ++next_file) {
+            unread.push_back(next_file);
+        }
+        std::ranges::sort(unread);
+    }
+    return unread;
+}
+
+auto batchreader::read_files_pread(const std::vector<std::string>& filenames, const Callback& callback, const std::atomic<bool>& stop) -> void {
+    for (std::size_t idx = 0; (idx < filenames.size()) && !stop; ++idx) {
+        struct stat st;
+        if (stat(filenames[idx].c_str(), &st) != 0) {
+            continue;
+        }
+        auto lines = std::make_shared<linestore::LineStore>();
+        if (!linestore::load_file(filenames[idx], *lines)) {
+            continue;
+        }
+        auto mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+        callback(File{.idx=idx, .size=st.st_size, .mtime=mtime, .lines=lines});
+    }
+}
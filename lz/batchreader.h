@@ -0,0 +1,84 @@
+#ifndef SUBSEQSEARCH_BATCHREADER_H
+#define SUBSEQSEARCH_BATCHREADER_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "linestore.h"
+
+namespace batchreader {
+
+/**
+ * A file that was read.
+ *
+ *   idx: index of the file in the list of files given to the reader.
+ *   size: size of the file in bytes.
+ *   mtime: modification time of the file (in ns).
+ *   lines: contents of the file.
+*/
+struct File {
+    std::size_t idx;
+    std::int64_t size;
+    std::int64_t mtime;
+    std::shared_ptr<linestore::LineStore> lines;
+};
+
+using Callback = std::function<void (File&&)>;
+
+/**
+ * Maximum number of files being read at the same time by
+ * `read_files_uring`.
+*/
+constexpr unsigned int max_in_flight = 64;
+
+/**
+ * Size of the buffer of each file being read by `read_files_uring`.
+*/
+constexpr unsigned int buffer_size = 1 << 16;
+
+/**
+ * Read many files.
+ *
+ * This uses `read_files_uring` if io_uring is available, and
+ * `read_files_pread` otherwise, or for the files that
+ * `read_files_uring` left after an error.  Files that can't be read
+ * are skipped.
+ *
+ * @param filenames files to read.
+ * @param callback called with each file once it is read.  Files can
+ *      be passed in any order.
+ * @param stop reading stops early once this is true.
+*/
+auto read_files(const std::vector<std::string>& filenames, const Callback& callback, const std::atomic<bool>& stop) -> void;
+
+/**
+ * Read many files with io_uring.
+ *
+ * Up to `max_in_flight` files are read at once.  Each has a
+ * registered buffer of `buffer_size` bytes.  The stat, open, read and
+ * close of every file are queued on the ring, and completions are
+ * handled in batches, so each round trip to the kernel serves many
+ * files.
+ *
+ * On an error of the ring, the requests in flight are waited for, and
+ * the files not handed to the callback yet are left unread.
+ *
+ * @return nothing if io_uring can't be used (nothing is read in this
+ *      case), or else the indexes of the files left unread after an
+ *      error, in increasing order.
+*/
+auto read_files_uring(const std::vector<std::string>& filenames, const Callback& callback, const std::atomic<bool>& stop) -> std::optional<std::vector<std::size_t>>;
+
+/**
+ * Read many files with `stat`, `open`, `read` and `close` per file.
+*/
+auto read_files_pread(const std::vector<std::string>& filenames, const Callback& callback, const std::atomic<bool>& stop) -> void;
+
+} // namespace batchreader
+
+#endif
@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <sys/stat.h>
+
+#include "batchreader.h"
+#include "filecache.h"
+#include "linestore.h"
+
+/**
+ * Get the cache key of a file.
+ *
+ * @return `(size, mtime)` of the file, or `(-1, -1)` if it can't be
+ *      stat'd.
+*/
+auto get_file_key(const std::string& filename) -> std::pair<std::int64_t, std::int64_t> {
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) {
+        return {-1, -1};
+    }
+    return {st.st_size, st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec};
+}
+
+auto filecache::is_current(const std::string& filename, const Entry& entry) -> bool {
+    const auto [size, mtime] = get_file_key(filename);
+    return (entry.size == size) && (entry.mtime == mtime);
+}
+
+filecache::FileCache::~FileCache() {
+    stop_prefetch = true;
+    if (prefetcher.joinable()) {
+        prefetcher.join();
+    }
+}
+
+auto filecache::FileCache::prefetch(const std::vector<std::string>& filenames) -> void {
+    if (prefetcher.joinable()) {
+        return;
+    }
+    auto keys = std::vector<std::pair<std::int64_t, std::int64_t>>();
+    keys.reserve(filenames.size());
+    for (const auto& filename : filenames) {
+        keys.push_back(get_file_key(filename));
+    }
+
+    auto small = std::vector<std::string>();
+    auto large = std::vector<std::string>();
+    {
+        auto lock = std::lock_guard(mutex);
+        for (std::size_t j = 0; j < filenames.size(); ++j) {
+            const auto& filename = filenames[j];
+            const auto [size, mtime] = keys[j];
+            if (auto it = entries.find(filename); it != std::end(entries)) {
+                if ((it->second.size == size) && (it->second.mtime == mtime)) {
+                    continue;
+                }
+                entries.erase(it);
+            }
+            if (!pending.insert(filename).second) {
+                continue;
+            }
+            (std::size_t(std::max(size, std::int64_t(0))) >= linestore::parallel_load_size ? large : small).push_back(filename);
+        }
+    }
+    if (small.empty() && large.empty()) {
+        return;
+    }
+
+    prefetcher = std::thread([this, small = std::move(small), large = std::move(large)]() {
+        // Cache a file read by the prefetcher, and wake up the
+        // searches waiting for it.
+        const auto insert = [&](const std::string& filename, Entry&& entry) {
+            const auto lines = entry.lines;
+            bool inserted;
+            {
+                // Don't replace anything `get` read in the meantime.
+                auto lock = std::lock_guard(mutex);
+                inserted = entries.try_emplace(filename, std::move(entry)).second;
+                pending.erase(filename);
+            }
+            loaded.notify_all();
+            if (inserted && on_load) {
+                on_load(lines);
+            }
+        };
+        // Let searches read the files that the prefetcher didn't.
+        const auto give_up = [&](const std::vector<std::string>& filenames) {
+            {
+                auto lock = std::lock_guard(mutex);
+                for (const auto& filename : filenames) {
+                    pending.erase(filename);
+                }
+            }
+            loaded.notify_all();
+        };
+
+        batchreader::read_files(small, [&](batchreader::File&& file) {
+                insert(small[file.idx], Entry{.size=file.size, .mtime=file.mtime, .lines=std::move(file.lines)});
+                }, stop_prefetch);
+        give_up(small);
+
+        for (const auto& filename : large) {
+            if (stop_prefetch) {
+                break;
+            }
+            const auto [size, mtime] = get_file_key(filename);
+            auto lines = std::make_shared<linestore::LineStore>(filename);
+            if (linestore::load_file(filename, *lines, n_threads)) {
+                insert(filename, Entry{.size=size, .mtime=mtime, .lines=std::move(lines)});
+            }
+            else {
+                give_up({filename});
+            }
+        }
+        give_up(large);
+    });
+}
+
+auto filecache::FileCache::get(const std::string& filename) -> std::shared_ptr<const linestore::LineStore> {
+    return get_entry(filename).lines;
+}
+
+auto filecache::FileCache::get_entry(const std::string& filename) -> Entry {
+    {
+        auto lock = std::unique_lock(mutex);
+        loaded.wait(lock, [&]() { return entries.contains(filename) || !pending.contains(filename); });
+        if (auto it = entries.find(filename); it != std::end(entries)) {
+            return it->second;
+        }
+    }
+
+    const auto [size, mtime] = get_file_key(filename);
+    // Read outside the lock so that the prefetcher and searches don't
+    // wait on each other.
+    auto lines = std::make_shared<linestore::LineStore>(filename);
+    if (!linestore::load_file(filename, *lines, n_threads)) {
+        lines = std::make_shared<linestore::LineStore>(filename);
+    }
+
+    if (on_load) {
+        on_load(lines);
+    }
+    auto lock = std::lock_guard(mutex);
+    return entries[filename] = Entry{.size=size, .mtime=mtime, .lines=lines};
+}
+
+auto filecache::FileCache::find(const std::string& filename) -> std::shared_ptr<const linestore::LineStore> {
+    auto lock = std::lock_guard(mutex);
+    auto it = entries.find(filename);
+    return (it != std::end(entries)) ? it->second.lines : nullptr;
+}
+
+auto filecache::FileCache::find_key(const std::string& filename) -> std::optional<std::pair<std::int64_t, std::int64_t>> {
+    auto lock = std::lock_guard(mutex);
+    auto it = entries.find(filename);
+    if (it == std::end(entries)) {
+        return std::nullopt;
+    }
+    return std::pair(it->second.size, it->second.mtime);
+}
+
+auto filecache::FileCache::add(const std::string& filename, Entry&& entry) -> void {
+    if (on_load) {
+        on_load(entry.lines);
+    }
+    auto lock = std::lock_guard(mutex);
+    entries[filename] = std::move(entry);
+}
+
+auto filecache::FileCache::refresh() -> void {
+    auto cached = std::vector<std::pair<std::string, Entry>>();
+    {
+        auto lock = std::lock_guard(mutex);
+        cached.assign(std::begin(entries), std::end(entries));
+    }
+
+    // Stat outside the lock, and only drop entries that weren't
+    // replaced in the meantime.
+    for (const auto& [filename, entry] : cached) {
+        const auto [size, mtime] = get_file_key(filename);
+        if ((entry.size == size) && (entry.mtime == mtime)) {
+            continue;
+        }
+        auto lock = std::lock_guard(mutex);
+        if (auto it = entries.find(filename); (it != std::end(entries)) && (it->second.lines == entry.lines)) {
+            entries.erase(it);
+        }
+    }
+}
+
+auto filecache::FileCache::is_current(const std::string& filename) -> bool {
+    const auto [size, mtime] = get_file_key(filename);
+    auto lock = std::lock_guard(mutex);
+    auto it = entries.find(filename);
+    return (it != std::end(entries)) && (it->second.size == size) && (it->second.mtime == mtime);
+}
+
+auto filecache::FileCache::get(const std::vector<std::string>& filenames) -> std::vector<std::shared_ptr<const linestore::LineStore>> {
+    auto stores = std::vector<std::shared_ptr<const linestore::LineStore>>();
+    stores.reserve(filenames.size());
+    for (const auto& filename : filenames) {
+        stores.emplace_back(get(filename));
+    }
+    return stores;
+}
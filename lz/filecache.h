@@ -0,0 +1,158 @@
+#ifndef SUBSEQSEARCH_FILECACHE_H
+#define SUBSEQSEARCH_FILECACHE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "linestore.h"
+
+namespace filecache {
+
+/**
+ * A cached file.
+ *
+ *   size: size of the file in bytes when it was read.
+ *   mtime: modification time of the file (in ns) when it was read.
+ *   lines: contents of the file.
+*/
+struct Entry {
+    std::int64_t size;
+    std::int64_t mtime;
+    std::shared_ptr<const linestore::LineStore> lines;
+};
+
+/**
+ * @return true if `filename` has the size and modification time of
+ *      `entry`.
+*/
+auto is_current(const std::string& filename, const Entry& entry) -> bool;
+
+/**
+ * Cache of file contents for repeated searches over the same files.
+ *
+ * Entries are keyed by `(path, size, mtime)`.  Cached files are not
+ * stat'd on each lookup: `refresh` drops the entries of files whose
+ * size or modification time changed, so that they are read again by
+ * the next lookup.  The cache can be filled in the background with
+ * `prefetch`, so that searches after startup don't read the files
+ * again.
+*/
+class FileCache {
+
+    public:
+        /**
+         * @param n_threads number of threads to read large files
+         *      with (see `linestore::load_file`).
+        */
+        explicit FileCache(unsigned int n_threads = 1) : entries(), pending(), stop_prefetch(false), n_threads(n_threads), on_load() {}
+        ~FileCache();
+
+        FileCache(const FileCache&) = delete;
+        auto operator=(const FileCache&) -> FileCache& = delete;
+
+        /**
+         * Start reading `filenames` into the cache on a background
+         * thread.  Files that are cached and haven't changed are not
+         * read again.
+         *
+         * Files of at least `linestore::parallel_load_size` bytes are
+         * read with `n_threads` threads each (see
+         * `linestore::load_file`), and the others all at once (see
+         * `batchreader::read_files`).  Getting a file that is still to
+         * be read waits for the prefetcher instead of reading it
+         * again.
+        */
+        auto prefetch(const std::vector<std::string>& filenames) -> void;
+
+        /**
+         * Get the contents of a file, reading it if it is not cached.
+         *
+         * @return contents of the file, or an empty store if the
+         *      file can't be read.
+        */
+        auto get(const std::string& filename) -> std::shared_ptr<const linestore::LineStore>;
+
+        /**
+         * Get the contents of a file along with its cache key,
+         * reading it if it is not cached.
+        */
+        auto get_entry(const std::string& filename) -> Entry;
+
+        /**
+         * Get the contents of a file if it is cached, without reading
+         * or waiting for it.
+         *
+         * @return contents of the file, or nullptr if it is not
+         *      cached.
+        */
+        auto find(const std::string& filename) -> std::shared_ptr<const linestore::LineStore>;
+
+        /**
+         * Get the cache key of a file if it is cached, without
+         * reading, waiting for or stat'ing it.
+         *
+         * @return `(size, mtime)` of the file when it was read, or
+         *      nothing if it is not cached.
+        */
+        auto find_key(const std::string& filename) -> std::optional<std::pair<std::int64_t, std::int64_t>>;
+
+        /**
+         * Get the contents of several files.
+         *
+         * @return contents of the files in the same order as
+         *      `filenames`.
+        */
+        auto get(const std::vector<std::string>& filenames) -> std::vector<std::shared_ptr<const linestore::LineStore>>;
+
+        /**
+         * Add contents read elsewhere (eg. from a snapshot).
+         *
+         * They are used as long as the file has the size and
+         * modification time given in `entry`.
+        */
+        auto add(const std::string& filename, Entry&& entry) -> void;
+
+        /**
+         * Drop the entries of files that changed since they were
+         * cached.  Each cached file is stat'd once, eg. when a new
+         * search session starts.
+        */
+        auto refresh() -> void;
+
+        /**
+         * @return true if `filename` is cached and hasn't changed.
+        */
+        auto is_current(const std::string& filename) -> bool;
+
+        /**
+         * Call `f` with the contents of each file cached from now on,
+         * whether read (from any thread) or added.  This should be
+         * set before anything is cached.
+        */
+        auto set_on_load(std::function<void (const std::shared_ptr<const linestore::LineStore>&)> f) -> void { on_load = std::move(f); }
+
+    private:
+        std::mutex mutex;
+        std::unordered_map<std::string, Entry> entries;
+        std::unordered_set<std::string> pending;
+        std::condition_variable loaded;
+        std::thread prefetcher;
+        std::atomic<bool> stop_prefetch;
+        unsigned int n_threads;
+        std::function<void (const std::shared_ptr<const linestore::LineStore>&)> on_load;
+};
+
+} // namespace filecache
+
+#endif
@@ -188,6 +188,27 @@ auto filtertree::FilterTree::is_match(const std::string& haystack) const -> bool
     return true;
 }
 
+auto filtertree::FilterTree::get_required() const -> std::vector<const Filter*> {
+    auto required = std::vector<const Filter*>();
+    const auto add_variables = [&](const auto& and_factors) {
+        for (const auto& and_factor : and_factors) {
+            if (const auto* variable = dynamic_cast<const VariableNode*>(and_factor.get()); variable != nullptr) {
+                required.push_back(&variable->get_filter());
+            }
+        }
+    };
+    if (flat_node) {
+        const auto& or_of_ands = static_cast<const FlatNode&>(*flat_node).or_of_ands;
+        if (or_of_ands.size() == 1) {
+            add_variables(or_of_ands[0]);
+        }
+    }
+    else if (root && (root->children.size() == 1)) {
+        add_variables(root->children[0]->children);
+    }
+    return required;
+}
+
 auto filtertree::FilterTree::print() const -> void {
     if (flat_node) {
         flat_node->print();
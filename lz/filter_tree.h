@@ -222,6 +222,10 @@ class VariableNode : public FilterNode {
         virtual auto print() const -> void {
             std::cout << (filter->negate ? "NOT " : "") << filter->qdata.q << std::endl;
         };
+        /**
+         * @return the filter of this variable.
+        */
+        auto get_filter() const -> const Filter& { return *filter; }
 
     private:
         std::unique_ptr<Filter> filter;
@@ -236,6 +240,7 @@ class VariableNode : public FilterNode {
  * of children (when the nodes are VariableNodes).
 */
 class FlatNode : public FilterNode {
+    friend class FilterTree;
 
     public:
         /**
@@ -291,6 +296,16 @@ class FilterTree {
          * @return the result of the expression.
         */
         auto is_match(const std::string& haystack) const -> bool;
+        /**
+         * Get the filters that every match of the expression passes.
+         *
+         * These are the variables AND'd at the top level, when the
+         * expression has no top level OR.  Groups are skipped.
+         *
+         * @return the filters, which may be negated.  This is empty if
+         *      the tree is empty or has a top level OR.
+        */
+        auto get_required() const -> std::vector<const Filter*>;
         /**
          * Print the tree.
         */
@@ -0,0 +1,436 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <functional>
+#include <optional>
+#include <queue>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fmindex.h"
+#include "linestore.h"
+#include "scheduler.h"
+#include "suffixarray.h"
+
+namespace {
+
+/**
+ * Chunks are about this many bytes of lines.  Building the index of a
+ * chunk takes about 10 bytes per byte of it.
+*/
+constexpr std::size_t chunk_size = std::size_t(1) << 25;
+
+/**
+ * ASCII case folding of `c`.
+*/
+auto fold(std::uint8_t c) -> std::uint8_t {
+    return ((c >= 'A') && (c <= 'Z')) ? (c - 'A' + 'a') : c;
+}
+
+/**
+ * @return the other ASCII case of `c`, or `c` if it has none.
+*/
+auto other_case(std::uint8_t c) -> std::uint8_t {
+    if ((c >= 'A') && (c <= 'Z')) {
+        return c - 'A' + 'a';
+    }
+    if ((c >= 'a') && (c <= 'z')) {
+        return c - 'a' + 'A';
+    }
+    return c;
+}
+
+} // namespace
+
+auto fmindex::BitVector::finish() -> void {
+    // Ranks at the very end of the bits look up the block after the
+    // last bit.
+    if (n % block_size == 0) {
+        blocks.emplace_back();
+    }
+    std::uint64_t rank = 0;
+    for (auto& block : blocks) {
+        block.rank = rank;
+        for (const auto word : block.words) {
+            rank += std::popcount(word);
+        }
+    }
+}
+
+fmindex::WaveletTree::WaveletTree(std::span<const std::uint8_t> bytes) : nodes(), codes(), code_lengths() {
+    auto freqs = std::array<std::uint64_t, 256>();
+    for (const auto c : bytes) {
+        ++freqs[c];
+    }
+
+    // Merge the two least frequent trees until one is left.  Trees
+    // are leaves (`~c`) or merged nodes, numbered in the order they
+    // are merged, so the root is merged last.
+    using Tree = std::pair<std::uint64_t, std::int32_t>;
+    auto queue = std::priority_queue<Tree, std::vector<Tree>, std::greater<>>();
+    for (int c = 0; c < 256; ++c) {
+        if (freqs[c] > 0) {
+            queue.emplace(freqs[c], ~c);
+        }
+    }
+    if (queue.empty()) {
+        return;
+    }
+    auto merged = std::vector<std::array<std::int32_t, 2>>();
+    if (queue.size() == 1) {
+        merged.push_back({queue.top().second, queue.top().second});
+    }
+    while (queue.size() > 1) {
+        const auto a = queue.top();
+        queue.pop();
+        const auto b = queue.top();
+        queue.pop();
+        merged.push_back({a.second, b.second});
+        queue.emplace(a.first + b.first, std::int32_t(merged.size() - 1));
+    }
+    const auto n_nodes = std::int32_t(merged.size());
+    for (auto j = n_nodes; j-- > 0;) {
+        auto children = merged[j];
+        for (auto& child : children) {
+            child = (child < 0) ? child : (n_nodes - 1 - child);
+        }
+        nodes.push_back(Node{.bits=BitVector(), .children=children});
+    }
+
+    // A byte's code is the path to its leaf.
+    const auto assign_codes = [&](const auto& self, std::int32_t node, std::uint64_t code, std::uint8_t length) -> void {
+        for (int bit = 0; bit < 2; ++bit) {
+            const auto child = nodes[node].children[bit];
+            if (child >= 0) {
+                self(self, child, (code << 1) | bit, length + 1);
+            }
+            else if (code_lengths[~child] == 0) {
+                codes[~child] = (code << 1) | bit;
+                code_lengths[~child] = length + 1;
+            }
+        }
+    };
+    assign_codes(assign_codes, 0, 0, 0);
+
+    for (const auto c : bytes) {
+        std::int32_t node = 0;
+        for (auto d = code_lengths[c]; d-- > 0;) {
+            const bool bit = (codes[c] >> d) & 1;
+            nodes[node].bits.push_back(bit);
+            node = nodes[node].children[bit];
+        }
+    }
+    for (auto& node : nodes) {
+        node.bits.finish();
+    }
+}
+
+auto fmindex::WaveletTree::rank(std::uint8_t c, std::size_t j) const -> std::size_t {
+    std::int32_t node = 0;
+    for (auto d = code_lengths[c]; d-- > 0;) {
+        const bool bit = (codes[c] >> d) & 1;
+        j = nodes[node].bits.rank(bit, j);
+        node = nodes[node].children[bit];
+    }
+    return (code_lengths[c] == 0) ? 0 : j;
+}
+
+auto fmindex::WaveletTree::access_rank(std::size_t j) const -> std::pair<std::uint8_t, std::size_t> {
+    std::int32_t node = 0;
+    while (true) {
+        const auto& bits = nodes[node].bits;
+        const bool bit = bits.get(j);
+        j = bits.rank(bit, j);
+        node = nodes[node].children[bit];
+        if (node < 0) {
+            return {std::uint8_t(~node), j};
+        }
+    }
+}
+
+auto fmindex::WaveletTree::n_bytes() const -> std::size_t {
+    std::size_t n = sizeof(codes) + sizeof(code_lengths);
+    for (const auto& node : nodes) {
+        n += sizeof(node) + node.bits.n_bytes();
+    }
+    return n;
+}
+
+auto fmindex::Index::Chunk::step(std::uint32_t row) const -> std::pair<std::uint32_t, std::uint8_t> {
+    auto [c, rank] = bwt.access_rank(row);
+    if ((c == 0) && (primary < row)) {
+        --rank;
+    }
+    return {counts[c] + rank, c};
+}
+
+auto fmindex::Index::Chunk::find_rows(std::string_view pattern, bool ignore_case) const -> std::vector<std::pair<std::uint32_t, std::uint32_t>> {
+    const auto rank = [&](const std::uint8_t c, const std::uint32_t row) {
+        return bwt.rank(c, row) - (((c == 0) && (primary < row)) ? 1 : 0);
+    };
+
+    // Going backwards through the pattern, the rows of the suffixes
+    // that start with the rest of it are narrowed down to those that
+    // start with one more character.
+    auto ranges = std::vector<std::pair<std::uint32_t, std::uint32_t>>{{0, counts[256]}};
+    auto next = std::vector<std::pair<std::uint32_t, std::uint32_t>>();
+    for (auto j = pattern.size(); (j-- > 0) && !ranges.empty();) {
+        const auto c = static_cast<std::uint8_t>(pattern[j]);
+        const auto cases = std::array<std::uint8_t, 2>{c, other_case(c)};
+        const auto n_cases = (ignore_case && (cases[1] != c)) ? 2 : 1;
+        next.clear();
+        for (const auto& [beg, end] : ranges) {
+            for (int k = 0; k < n_cases; ++k) {
+                const auto next_beg = counts[cases[k]] + rank(cases[k], beg);
+                const auto next_end = counts[cases[k]] + rank(cases[k], end);
+                if (next_beg < next_end) {
+                    next.emplace_back(next_beg, next_end);
+                }
+            }
+        }
+        std::swap(ranges, next);
+    }
+    return ranges;
+}
+
+auto fmindex::Index::get_pattern(std::string_view literal, bool at_line_start, bool at_line_end) -> std::string {
+    auto pattern = std::string(at_line_start ? 1 : 0, '\0');
+    pattern += literal;
+    if (at_line_end) {
+        pattern.push_back('\0');
+    }
+    return pattern;
+}
+
+auto fmindex::Index::get_chunk(std::size_t j) const -> std::pair<const Chunk*, std::size_t> {
+    const auto k = std::ranges::upper_bound(first_lines, j) - std::cbegin(first_lines) - 1;
+    return {&chunks[k], j - first_lines[k]};
+}
+
+auto fmindex::Index::locate_line(const Chunk& chunk, std::uint32_t row) -> std::uint32_t {
+    while ((row < chunk.counts[0]) || (row >= chunk.counts[1])) {
+        row = chunk.step(row).first;
+    }
+    return chunk.null_lines[row - chunk.counts[0]];
+}
+
+template<typename F>
+auto fmindex::Index::for_each_char_backwards(const Chunk& chunk, std::size_t k, F f) -> void {
+    for (auto row = chunk.line_ends[k];;) {
+        const auto [prev_row, c] = chunk.step(row);
+        if ((c == 0) || !f(c)) {
+            return;
+        }
+        row = prev_row;
+    }
+}
+
+auto fmindex::Index::count(std::string_view literal, bool at_line_start, bool at_line_end, bool ignore_case) const -> std::size_t {
+    const auto pattern = get_pattern(literal, at_line_start, at_line_end);
+    std::size_t n = 0;
+    for (const auto& chunk : chunks) {
+        for (const auto& [beg, end] : chunk.find_rows(pattern, ignore_case)) {
+            n += end - beg;
+        }
+    }
+    return n;
+}
+
+auto fmindex::Index::find(std::string_view literal, bool at_line_start, bool at_line_end, bool ignore_case) const -> std::optional<std::vector<std::uint32_t>> {
+    if (literal.empty()) {
+        return std::nullopt;
+    }
+    const auto pattern = get_pattern(literal, at_line_start, at_line_end);
+    auto lines = std::vector<std::uint32_t>();
+    auto chunk_lines = std::vector<std::uint32_t>();
+    for (std::size_t k = 0; k < chunks.size(); ++k) {
+        const auto& chunk = chunks[k];
+        chunk_lines.clear();
+        for (const auto& [beg, end] : chunk.find_rows(pattern, ignore_case)) {
+            for (auto row = beg; row < end; ++row) {
+                // Matches at the start of a line start at the null
+                // byte before it, which is the line's.
+                chunk_lines.push_back(locate_line(chunk, row));
+            }
+        }
+        std::ranges::sort(chunk_lines);
+        const auto [last, end] = std::ranges::unique(chunk_lines);
+        for (auto line = std::cbegin(chunk_lines); line != last; ++line) {
+            lines.push_back(first_lines[k] + *line);
+        }
+    }
+    return lines;
+}
+
+auto fmindex::Index::line(std::size_t j) const -> std::string {
+    const auto [chunk, k] = get_chunk(j);
+    auto line = std::string();
+    for_each_char_backwards(*chunk, k, [&](const auto c) {
+            line.push_back(char(c));
+            return true;
+            });
+    std::ranges::reverse(line);
+    return line;
+}
+
+auto fmindex::Index::has_subsequences(std::size_t j, std::span<const std::string> patterns, bool ignore_case) const -> bool {
+    // Each pattern is matched from its last character on.
+    auto n_left = std::vector<std::size_t>();
+    std::size_t n_patterns_left = 0;
+    for (const auto& pattern : patterns) {
+        n_left.push_back(pattern.size());
+        n_patterns_left += pattern.empty() ? 0 : 1;
+    }
+    if (n_patterns_left == 0) {
+        return true;
+    }
+
+    const auto [chunk, k] = get_chunk(j);
+    for_each_char_backwards(*chunk, k, [&](const auto c) {
+            for (std::size_t i = 0; i < patterns.size(); ++i) {
+                if (n_left[i] == 0) {
+                    continue;
+                }
+                const auto p = static_cast<std::uint8_t>(patterns[i][n_left[i] - 1]);
+                if ((c == p) || (ignore_case && (fold(c) == fold(p)))) {
+                    --n_left[i];
+                    n_patterns_left -= (n_left[i] == 0) ? 1 : 0;
+                }
+            }
+            return n_patterns_left > 0;
+            });
+    return n_patterns_left == 0;
+}
+
+auto fmindex::Index::n_bytes() const -> std::size_t {
+    std::size_t n = first_lines.size() * sizeof(first_lines[0]);
+    for (const auto& chunk : chunks) {
+        n += sizeof(chunk) + chunk.bwt.n_bytes();
+        n += (chunk.null_lines.size() + chunk.line_ends.size()) * sizeof(std::uint32_t);
+    }
+    return n;
+}
+
+auto fmindex::Index::build_chunk(const linestore::LineStore& lines, std::size_t beg, std::size_t end) -> Chunk {
+    // Lines are indexed up to their first null byte, as the filters see
+    // them, so that null bytes only separate lines.
+    auto chunk = Chunk();
+    auto text = std::vector<std::uint8_t>{0};
+    auto line_starts = std::vector<std::uint32_t>();
+    for (auto j = beg; j < end; ++j) {
+        line_starts.push_back(text.size());
+        const auto line = std::string_view(lines.c_str(j));
+        text.insert(std::end(text), std::cbegin(line), std::cend(line));
+        text.push_back(0);
+    }
+    line_starts.push_back(text.size());
+
+    auto freqs = std::array<std::uint32_t, 256>();
+    for (const auto c : text) {
+        ++freqs[c];
+    }
+    chunk.counts[0] = 1;
+    for (int c = 0; c < 256; ++c) {
+        chunk.counts[c + 1] = chunk.counts[c] + freqs[c];
+    }
+
+    // The rows are the suffixes in order, the empty one first.  The
+    // character before each suffix is its character in the transform.
+    const std::uint32_t n = text.size();
+    const auto sorted = suffixarray::sort_suffixes(text);
+    auto bwt = std::vector<std::uint8_t>(n + 1);
+    chunk.null_lines.resize(freqs[0]);
+    chunk.line_ends.resize(freqs[0] - 1);
+    bwt[0] = 0;
+    for (std::uint32_t row = 1; row <= n; ++row) {
+        const auto pos = sorted[row - 1];
+        if (pos == 0) {
+            chunk.primary = row;
+        }
+        bwt[row] = (pos == 0) ? 0 : text[pos - 1];
+        if (text[pos] == 0) {
+            const std::uint32_t line = std::ranges::lower_bound(line_starts, pos + 1) - std::cbegin(line_starts);
+            chunk.null_lines[row - chunk.counts[0]] = line;
+            if (line > 0) {
+                chunk.line_ends[line - 1] = row;
+            }
+        }
+    }
+    chunk.bwt = WaveletTree(bwt);
+    return chunk;
+}
+
+auto fmindex::build(const linestore::LineStore& lines, unsigned int n_threads) -> Index {
+    auto index = Index();
+    index.name = lines.get_name();
+
+    const auto offsets = lines.get_offsets();
+    auto ranges = std::vector<std::pair<std::size_t, std::size_t>>();
+    for (std::size_t k = 0; k < lines.size();) {
+        const auto beg = k;
+        for (++k; (k < lines.size()) && (offsets[k] - offsets[beg] < chunk_size); ++k) {}
+        ranges.emplace_back(beg, k);
+        index.first_lines.push_back(k);
+    }
+
+    index.chunks.resize(ranges.size());
+    scheduler::run(ranges.size(), std::max(n_threads, 1u), [&](const auto worker, const auto j) {
+            index.chunks[j] = Index::build_chunk(lines, ranges[j].first, ranges[j].second);
+            });
+    return index;
+}
+
+auto fmindex::load_file(const std::string& filename, Index& index, unsigned int n_threads) -> bool {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    // Files like the ones in /proc report a size of 0, so they are read
+    // whole.
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || (st.st_size == 0)) {
+        close(fd);
+        auto lines = linestore::LineStore();
+        if (!linestore::load_file(filename, lines)) {
+            return false;
+        }
+        index = build(lines, n_threads);
+        return true;
+    }
+
+    n_threads = std::max(n_threads, 1u);
+    const auto ranges = linestore::split_lines(fd, st.st_size, chunk_size);
+    auto stores = std::vector<linestore::LineStore>(n_threads);
+    auto chunks = std::vector<Index::Chunk>(ranges.size());
+    auto n_lines = std::vector<std::size_t>(ranges.size());
+    auto failed = std::atomic<bool>(false);
+    scheduler::run(ranges.size(), n_threads, [&](const auto worker, const auto j) {
+            auto& store = stores[worker];
+            if (failed || !linestore::load_range(fd, ranges[j].first, ranges[j].second, store)) {
+                failed = true;
+                return;
+            }
+            n_lines[j] = store.size();
+            chunks[j] = Index::build_chunk(store, 0, store.size());
+            });
+    close(fd);
+    if (failed) {
+        return false;
+    }
+
+    index = Index();
+    index.name = filename;
+    index.chunks = std::move(chunks);
+    for (const auto n : n_lines) {
+        index.first_lines.push_back(index.first_lines.back() + n);
+    }
+    return true;
+}
@@ -0,0 +1,343 @@
+#ifndef SUBSEQSEARCH_FMINDEX_H
+#define SUBSEQSEARCH_FMINDEX_H
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "linestore.h"
+
+namespace fmindex {
+
+/**
+ * Bits with constant time rank.
+ *
+ * Bits are kept in blocks of a cache line, each with the number of
+ * ones before it, so that a rank reads a single cache line.  This
+ * costs 1/7 more space.
+ *
+ *   blocks: the bits, lowest first.
+ *   n: number of bits.
+*/
+class BitVector {
+
+    public:
+        BitVector() : blocks(), n(0) {}
+
+        /**
+         * Append a bit.  `finish` must be called once all bits are
+         * appended.
+        */
+        auto push_back(bool bit) -> void {
+            if (n % block_size == 0) {
+                blocks.emplace_back();
+            }
+            const auto j = n % block_size;
+            blocks.back().words[j / 64] |= std::uint64_t(bit) << (j % 64);
+            ++n;
+        }
+
+        /**
+         * Count the ones before each block.
+        */
+        auto finish() -> void;
+
+        /**
+         * @return the `j`th bit.
+        */
+        auto get(std::size_t j) const -> bool {
+            const auto k = j % block_size;
+            return (blocks[j / block_size].words[k / 64] >> (k % 64)) & 1;
+        }
+
+        /**
+         * @return number of ones in `[0, j)`.
+        */
+        auto rank1(std::size_t j) const -> std::size_t {
+            const auto& block = blocks[j / block_size];
+            const auto k = j % block_size;
+            std::size_t rank = block.rank;
+            for (std::size_t w = 0; w < k / 64; ++w) {
+                rank += std::popcount(block.words[w]);
+            }
+            if (k % 64 != 0) {
+                rank += std::popcount(block.words[k / 64] << (64 - (k % 64)));
+            }
+            return rank;
+        }
+
+        /**
+         * @return number of `bit`s in `[0, j)`.
+        */
+        auto rank(bool bit, std::size_t j) const -> std::size_t { return bit ? rank1(j) : (j - rank1(j)); }
+
+        /**
+         * @return number of bytes used.
+        */
+        auto n_bytes() const -> std::size_t { return blocks.size() * sizeof(Block); }
+
+    private:
+        /**
+         * Number of bits in a block.
+        */
+        static constexpr std::size_t block_size = 7 * 64;
+
+        /**
+         * A block of bits.
+         *
+         *   rank: number of ones before the block.
+         *   words: the bits of the block, 64 to a word.
+        */
+        struct alignas(64) Block {
+            std::uint64_t rank = 0;
+            std::array<std::uint64_t, 7> words = {};
+        };
+
+        std::vector<Block> blocks;
+        std::size_t n;
+};
+
+/**
+ * A Huffman shaped wavelet tree of a sequence of bytes.
+ *
+ * Each byte is stored as the bits of its Huffman code, one bit per
+ * node on the path from the root to its leaf, so the tree takes about
+ * as many bits as the sequence compressed with Huffman codes.  Rank
+ * queries go down the path of a byte, and access goes down the path
+ * given by the bits.
+ *
+ *   nodes: the internal nodes, the root first.
+ *   codes: the Huffman code of each byte, with its first bit highest.
+ *   code_lengths: number of bits in the code of each byte, or 0 for
+ *          bytes that don't occur.
+*/
+class WaveletTree {
+
+    public:
+        WaveletTree() : nodes(), codes(), code_lengths() {}
+
+        /**
+         * @param bytes the sequence.
+        */
+        explicit WaveletTree(std::span<const std::uint8_t> bytes);
+
+        /**
+         * @return number of `c`s in `[0, j)`.
+        */
+        auto rank(std::uint8_t c, std::size_t j) const -> std::size_t;
+
+        /**
+         * @return the `j`th byte, and the number of times it occurs in
+         *      `[0, j)`.
+        */
+        auto access_rank(std::size_t j) const -> std::pair<std::uint8_t, std::size_t>;
+
+        /**
+         * @return number of bytes used.
+        */
+        auto n_bytes() const -> std::size_t;
+
+    private:
+        /**
+         * An internal node.
+         *
+         *   bits: the next bit of the code of each byte that goes
+         *          through the node, in order.
+         *   children: the child each bit goes to, as the index of a
+         *          node, or `~c` for the leaf of byte `c`.
+        */
+        struct Node {
+            BitVector bits;
+            std::array<std::int32_t, 2> children;
+        };
+
+        std::vector<Node> nodes;
+        std::array<std::uint64_t, 256> codes;
+        std::array<std::uint8_t, 256> code_lengths;
+};
+
+/**
+ * A compressed store of lines that can be searched without the lines:
+ * an FM-index (Ferragina and Manzini) of the lines.
+ *
+ * The lines are split into chunks of whole lines, as in
+ * `suffixarray::Index`, and each chunk is indexed on its own, so that
+ * chunks can be built in parallel (and from ranges of a file, without
+ * reading the whole file at once).  The text of a chunk is its lines,
+ * each preceded by a null byte, followed by a null byte, so that
+ * prefixes and suffixes of lines can be searched as such.
+ *
+ * The Burrows-Wheeler transform of the text of a chunk is kept in a
+ * wavelet tree, so it takes about as much space as the text compressed
+ * with Huffman codes.  Instead of samples of the suffix array, the
+ * rows of the suffixes that start with a null byte are mapped to the
+ * lines that follow them and back: lines are extracted by going
+ * backwards from the null byte that ends them to the one before them,
+ * and matches are found by going backwards to the start of their
+ * line.  This costs as much as the offsets of a `linestore::LineStore`
+ * and no step is wasted, but finding matches in long lines is slower.
+ *
+ *   name: name of the source of the lines.
+ *   chunks: the index of each chunk.
+ *   first_lines: the id of the first line of each chunk, followed by
+ *          the number of lines.
+*/
+class Index {
+    friend auto build(const linestore::LineStore& lines, unsigned int n_threads) -> Index;
+    friend auto load_file(const std::string& filename, Index& index, unsigned int n_threads) -> bool;
+
+    public:
+        Index() : name(), chunks(), first_lines{0} {}
+
+        /**
+         * Count the occurrences of `literal` in the lines.
+         *
+         * @param at_line_start whether to count the occurrences that
+         *      start a line only.
+         * @param at_line_end whether to count the occurrences that end
+         *      a line only.
+         * @param ignore_case whether to count the occurrences in any
+         *      case (ASCII).
+        */
+        auto count(std::string_view literal, bool at_line_start = false, bool at_line_end = false, bool ignore_case = false) const -> std::size_t;
+
+        /**
+         * Find the lines that contain `literal` (see `count`).
+         *
+         * @return ids of the lines in increasing order, or nothing if
+         *      `literal` is empty.
+        */
+        auto find(std::string_view literal, bool at_line_start = false, bool at_line_end = false, bool ignore_case = false) const -> std::optional<std::vector<std::uint32_t>>;
+
+        /**
+         * @return the `j`th line.
+        */
+        auto line(std::size_t j) const -> std::string;
+
+        /**
+         * Check whether each of `patterns` is a subsequence of the
+         * `j`th line, going backwards through the line (as a backward
+         * search does), without extracting it.
+         *
+         * @param ignore_case whether to match the patterns in any case
+         *      (ASCII).
+        */
+        auto has_subsequences(std::size_t j, std::span<const std::string> patterns, bool ignore_case = false) const -> bool;
+
+        /**
+         * @return number of lines.
+        */
+        auto size() const -> std::size_t { return first_lines.back(); }
+
+        /**
+         * @return number of bytes used by the index.
+        */
+        auto n_bytes() const -> std::size_t;
+
+        /**
+         * @return name of the source the lines come from.
+        */
+        auto get_name() const -> const std::string& { return name; }
+
+    private:
+        /**
+         * The FM-index of a chunk.
+         *
+         *   bwt: the Burrows-Wheeler transform of the text.  The row of
+         *          the whole text (which has nothing before it) holds
+         *          a null byte that isn't counted.
+         *   counts: number of characters of the text smaller than each
+         *          byte, plus one for the empty suffix.  The rows of
+         *          the suffixes that start with a null byte are
+         *          `[counts[0], counts[1])`.
+         *   primary: the row of the whole text.
+         *   null_lines: the line after the null byte of each row that
+         *          starts with one (the null byte at the end of the
+         *          text is followed by the number of lines).
+         *   line_ends: the row of the null byte that ends each line.
+        */
+        struct Chunk {
+            WaveletTree bwt;
+            std::array<std::uint32_t, 257> counts;
+            std::uint32_t primary;
+            std::vector<std::uint32_t> null_lines;
+            std::vector<std::uint32_t> line_ends;
+
+            /**
+             * @return the row of the suffix that starts one character
+             *      before the suffix of row `row`, and that character.
+            */
+            auto step(std::uint32_t row) const -> std::pair<std::uint32_t, std::uint8_t>;
+
+            /**
+             * @return the rows of the suffixes that start with
+             *      `pattern`, as ranges `[beg, end)`.  If `ignore_case`
+             *      is set, each case of the pattern has its range.
+            */
+            auto find_rows(std::string_view pattern, bool ignore_case) const -> std::vector<std::pair<std::uint32_t, std::uint32_t>>;
+        };
+
+        /**
+         * Index lines `[beg, end)` of a store as a chunk.
+        */
+        static auto build_chunk(const linestore::LineStore& lines, std::size_t beg, std::size_t end) -> Chunk;
+
+        /**
+         * @return the chunk that the `j`th line is in, and the index
+         *      of the line in it.
+        */
+        auto get_chunk(std::size_t j) const -> std::pair<const Chunk*, std::size_t>;
+
+        /**
+         * Call `f(c)` with each character of the `k`th line of `chunk`,
+         * from last to first, until it returns false.
+        */
+        template<typename F>
+        static auto for_each_char_backwards(const Chunk& chunk, std::size_t k, F f) -> void;
+
+        /**
+         * @return the line of `chunk` that the suffix of row `row`
+         *      starts in (or right before, for a null byte).
+        */
+        static auto locate_line(const Chunk& chunk, std::uint32_t row) -> std::uint32_t;
+
+        /**
+         * @return `literal` preceded and followed by a null byte as
+         *      the anchors ask for.
+        */
+        static auto get_pattern(std::string_view literal, bool at_line_start, bool at_line_end) -> std::string;
+
+        std::string name;
+        std::vector<Chunk> chunks;
+        std::vector<std::size_t> first_lines;
+};
+
+/**
+ * Index the lines of a store.
+ *
+ * Chunks are indexed by `n_threads` threads at once.  The store isn't
+ * needed afterwards.
+*/
+auto build(const linestore::LineStore& lines, unsigned int n_threads = 1) -> Index;
+
+/**
+ * Index the lines of a file, without reading it whole.
+ *
+ * The file is split into ranges of whole lines (see
+ * `linestore::split_lines`), and `n_threads` threads read and index
+ * one range at a time each, so only that many ranges are read at once.
+ * The name of the index is set to `filename`.
+ *
+ * @return false if the file could not be read, true otherwise.
+*/
+auto load_file(const std::string& filename, Index& index, unsigned int n_threads = 1) -> bool;
+
+} // namespace fmindex
+
+#endif
@@ -135,6 +135,10 @@ class Fuzzy {
          * Print all queries given in the constructor.
         */
         auto print() const -> void;
+        /**
+         * @return the queries given in the constructor.
+        */
+        auto get_queries() const -> const std::vector<qdata::QueryData>& { return queries; }
 
     private:
         std::vector<qdata::QueryData> queries;
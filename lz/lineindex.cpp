@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "filters.h"
+#include "filter_tree.h"
+#include "fmindex.h"
+#include "lineindex.h"
+#include "linestore.h"
+#include "pairindex.h"
+#include "suffixarray.h"
+#include "tokenindex.h"
+#include "trigram.h"
+
+namespace {
+
+/**
+ * Number of lines of a file that can be read again in the time it takes
+ * to extract one of them from its FM-index.
+*/
+constexpr std::size_t regex_extract_cost = 64;
+
+/**
+ * Call `f(filter, is_prefix, is_suffix)` with each filter of a query
+ * that every match passes and that looks for a literal term: substring
+ * (`=`), prefix (`^`) and suffix (`$`) filters that aren't negated, of
+ * a query without `|` at its top level.  Stop once `f` returns false.
+*/
+template<typename F>
+auto for_each_required_literal(const filtertree::FilterTree& filter_tree, F f) -> void {
+    using FilterFn = const char*(*)(const char*, int, const qdata::QueryData&);
+    for (const auto* filter : filter_tree.get_required()) {
+        const auto* fn = filter->filter.target<FilterFn>();
+        if (filter->negate || (fn == nullptr) || ((*fn != filters::find) && (*fn != filters::find_prefix) && (*fn != filters::find_suffix))) {
+            continue;
+        }
+        if (!f(*filter, *fn == filters::find_prefix, *fn == filters::find_suffix)) {
+            return;
+        }
+    }
+}
+
+} // namespace
+
+lineindex::Indexer::~Indexer() {
+    {
+        auto lock = std::lock_guard(mutex);
+        stop = true;
+    }
+    queued.notify_all();
+    if (builder.joinable()) {
+        builder.join();
+    }
+}
+
+auto lineindex::Indexer::add(std::shared_ptr<const linestore::LineStore> lines) -> void {
+    {
+        auto lock = std::lock_guard(mutex);
+        std::erase_if(entries, [](const auto& entry) { return entry.second.lines.use_count() == 1; });
+        auto [it, inserted] = entries.try_emplace(lines.get(), Entry{.lines=lines, .indexes=Indexes()});
+        if (!inserted) {
+            return;
+        }
+        queue.push_back(std::move(lines));
+        if (!builder.joinable()) {
+            builder = std::thread([this]() { run(); });
+        }
+    }
+    queued.notify_one();
+}
+
+auto lineindex::Indexer::get(const linestore::LineStore& lines) const -> Indexes {
+    auto lock = std::lock_guard(mutex);
+    auto it = entries.find(&lines);
+    return (it != std::end(entries)) ? it->second.indexes : Indexes();
+}
+
+auto lineindex::Indexer::run() -> void {
+    while (true) {
+        auto lines = std::shared_ptr<const linestore::LineStore>();
+        {
+            auto lock = std::unique_lock(mutex);
+            queued.wait(lock, [&]() { return stop || !queue.empty(); });
+            if (stop) {
+                return;
+            }
+            lines = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        // Build outside the lock so that searches can get the indexes
+        // of the other stores in the meantime.  Each index is used as
+        // soon as it is built, the cheapest first.
+        const auto publish = [&](const auto set_index) {
+            auto lock = std::lock_guard(mutex);
+            if (auto it = entries.find(lines.get()); (it != std::end(entries)) && !stop) {
+                set_index(it->second.indexes);
+            }
+            return !stop;
+        };
+        if (index_pairs) {
+            auto pairs = std::make_shared<const pairindex::Index>(pairindex::build(*lines, n_threads, &stop));
+            if (!publish([&](auto& indexes) { indexes.pairs = std::move(pairs); })) {
+                return;
+            }
+        }
+        if (index_trigrams) {
+            auto trigrams = std::make_shared<const trigram::Index>(trigram::build(*lines, n_threads, &stop));
+            if (!publish([&](auto& indexes) { indexes.trigrams = std::move(trigrams); })) {
+                return;
+            }
+        }
+        if (index_suffixes) {
+            auto suffixes = std::make_shared<const suffixarray::Index>(suffixarray::build(*lines, n_threads, &stop));
+            if (!publish([&](auto& indexes) { indexes.suffixes = std::move(suffixes); })) {
+                return;
+            }
+        }
+        if (!word_delims.empty()) {
+            auto tokens = std::make_shared<const tokenindex::Index>(tokenindex::build(*lines, word_delims, n_threads, &stop));
+            if (!publish([&](auto& indexes) { indexes.tokens = std::move(tokens); })) {
+                return;
+            }
+        }
+    }
+}
+
+auto lineindex::find_candidates(const linestore::LineStore& lines, const Indexes& indexes, const filtertree::FilterTree& filter_tree, std::span<const std::string> fuzzy_terms) -> std::optional<std::vector<std::uint32_t>> {
+    if (!indexes.trigrams && !indexes.suffixes && !indexes.tokens && !indexes.pairs) {
+        return std::nullopt;
+    }
+
+    auto candidates = std::optional<std::vector<std::uint32_t>>();
+    const auto narrow = [&](std::optional<std::vector<std::uint32_t>>&& term_lines) {
+        if (term_lines) {
+            candidates = candidates ? trigram::intersect(*candidates, *term_lines) : std::move(*term_lines);
+        }
+    };
+    for_each_required_literal(filter_tree, [&](const auto& filter, const bool is_prefix, const bool is_suffix) {
+            // The suffix arrays answer any term exactly (up to case), but
+            // finding the line of each occurrence costs more than the
+            // posting lists once a term is in most lines.  Words are
+            // looked up only for terms too short for the trigrams, since
+            // short pieces of words can take a union of many posting
+            // lists.  The words of the term are only those of the lines if
+            // both are split alike.
+            const auto& term = filter.qdata.q;
+            auto term_lines = std::optional<std::vector<std::uint32_t>>();
+            if (indexes.suffixes && (indexes.suffixes->count(lines, term, is_suffix) <= lines.size() / 2)) {
+                term_lines = indexes.suffixes->find(lines, term, is_prefix, is_suffix);
+            }
+            if (!term_lines && indexes.trigrams) {
+                term_lines = indexes.trigrams->find(term);
+            }
+            if (!term_lines && indexes.tokens && (indexes.tokens->get_delims() == filter.qdata.word_delims)) {
+                term_lines = indexes.tokens->find(term, is_prefix, is_suffix);
+            }
+            narrow(std::move(term_lines));
+            return !candidates || !candidates->empty();
+            });
+    if (!indexes.pairs || fuzzy_terms.empty() || (candidates && candidates->empty())) {
+        return candidates;
+    }
+
+    // The lines left are those of the blocks that have the pairs of
+    // all terms.  Lines are listed only if some block is left out.
+    auto required = pairindex::Summary();
+    for (const auto& term : fuzzy_terms) {
+        required.add(term);
+    }
+    const auto& pairs = *indexes.pairs;
+    auto blocks = std::vector<bool>(pairs.n_blocks());
+    bool all_blocks = true;
+    for (std::size_t k = 0; k < blocks.size(); ++k) {
+        blocks[k] = pairs.may_contain(k, required);
+        all_blocks = all_blocks && blocks[k];
+    }
+    if (all_blocks) {
+        return candidates;
+    }
+    if (candidates) {
+        std::erase_if(*candidates, [&](const auto line) { return !blocks[line / pairindex::block_size]; });
+        return candidates;
+    }
+    candidates.emplace();
+    for (std::size_t k = 0; k < blocks.size(); ++k) {
+        if (blocks[k]) {
+            const auto end = std::min(pairs.size(), (k + 1) * pairindex::block_size);
+            for (auto line = k * pairindex::block_size; line < end; ++line) {
+                candidates->push_back(line);
+            }
+        }
+    }
+    return candidates;
+}
+
+auto lineindex::find_candidates(const fmindex::Index& lines, const filtertree::FilterTree& filter_tree) -> std::optional<std::vector<std::uint32_t>> {
+    auto candidates = std::optional<std::vector<std::uint32_t>>();
+    for_each_required_literal(filter_tree, [&](const auto& filter, const bool is_prefix, const bool is_suffix) {
+            // Finding the line of an occurrence goes back to the start of
+            // the line, which costs less than checking the line, unless
+            // the term occurs more often than there are lines left.
+            const auto& term = filter.qdata.q;
+            const bool ignore_case = filter.qdata.ignore_case;
+            const auto n_occurrences = lines.count(term, is_prefix, is_suffix, ignore_case);
+            if (n_occurrences > (candidates ? candidates->size() : lines.size())) {
+                return true;
+            }
+            if (auto term_lines = lines.find(term, is_prefix, is_suffix, ignore_case)) {
+                candidates = candidates ? trigram::intersect(*candidates, *term_lines) : std::move(*term_lines);
+            }
+            return !candidates || !candidates->empty();
+            });
+    return candidates;
+}
+
+auto lineindex::find_regex_candidates(const Indexes& indexes, const std::string& pattern) -> std::optional<std::vector<std::uint32_t>> {
+    if (!indexes.trigrams) {
+        return std::nullopt;
+    }
+    return indexes.trigrams->find_regex(pattern);
+}
+
+auto lineindex::find_regex_candidates(const fmindex::Index& lines, const std::string& pattern) -> std::optional<std::vector<std::uint32_t>> {
+    return trigram::find_regex(pattern, [&](const auto& literal) -> std::optional<std::vector<std::uint32_t>> {
+            if (lines.count(literal, false, false, true) > lines.size() / regex_extract_cost) {
+                return std::nullopt;
+            }
+            return lines.find(literal, false, false, true);
+            });
+}
@@ -0,0 +1,180 @@
+#ifndef SUBSEQSEARCH_LINEINDEX_H
+#define SUBSEQSEARCH_LINEINDEX_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "filter_tree.h"
+#include "fmindex.h"
+#include "linestore.h"
+#include "pairindex.h"
+#include "suffixarray.h"
+#include "tokenindex.h"
+#include "trigram.h"
+
+namespace lineindex {
+
+/**
+ * The indexes of a store that are built so far.
+ *
+ * Indexes that aren't built yet are null, and searches scan the lines
+ * instead.
+ *
+ *   trigrams: posting lists of the trigrams of the lines (see
+ *          `trigram::Index`).
+ *   suffixes: suffix arrays of the lines (see `suffixarray::Index`).
+ *   tokens: posting lists of the words of the lines (see
+ *          `tokenindex::Index`).
+ *   pairs: ordered pairs of characters of blocks of lines (see
+ *          `pairindex::Index`).
+*/
+struct Indexes {
+    std::shared_ptr<const trigram::Index> trigrams;
+    std::shared_ptr<const suffixarray::Index> suffixes;
+    std::shared_ptr<const tokenindex::Index> tokens;
+    std::shared_ptr<const pairindex::Index> pairs;
+};
+
+/**
+ * Builds the indexes of stores in the background.
+ *
+ * Stores are indexed one at a time, in the order they are added, by a
+ * thread started with the first one.  Stores must not change once
+ * added.  Searches take whatever indexes are ready with `get`, so they
+ * never wait for a build.
+ *
+ * Indexes are kept as long as their store is used elsewhere: the
+ * indexes of stores that only the indexer still holds (eg. files that
+ * were read again after changing) are dropped when the next store is
+ * added.
+*/
+class Indexer {
+
+    public:
+        /**
+         * @param n_threads number of threads to build each index
+         *      with (see `trigram::build`).
+         * @param index_trigrams whether to build the trigram index.
+         * @param index_suffixes whether to build the suffix arrays.
+         * @param word_delims characters that split lines into words
+         *      for the token index (see `tokenindex::build`), or
+         *      empty for no token index.
+         * @param index_pairs whether to summarize the ordered pairs of
+         *      characters of blocks of lines.
+        */
+        explicit Indexer(unsigned int n_threads = 1, bool index_trigrams = true, bool index_suffixes = false, std::string word_delims = "", bool index_pairs = false) : entries(), queue(), stop(false), n_threads(n_threads), index_trigrams(index_trigrams), index_suffixes(index_suffixes), word_delims(std::move(word_delims)), index_pairs(index_pairs) {}
+        ~Indexer();
+
+        Indexer(const Indexer&) = delete;
+        auto operator=(const Indexer&) -> Indexer& = delete;
+
+        /**
+         * Index a store in the background.  Stores that were already
+         * added are not indexed again.
+        */
+        auto add(std::shared_ptr<const linestore::LineStore> lines) -> void;
+
+        /**
+         * @return the indexes of `lines` that are built.  They are
+         *      all null if `lines` wasn't added or is still being
+         *      indexed.
+        */
+        auto get(const linestore::LineStore& lines) const -> Indexes;
+
+    private:
+        /**
+         * Index the queued stores until `stop` is set.
+        */
+        auto run() -> void;
+
+        struct Entry {
+            std::shared_ptr<const linestore::LineStore> lines;
+            Indexes indexes;
+        };
+
+        mutable std::mutex mutex;
+        std::condition_variable queued;
+        std::unordered_map<const linestore::LineStore*, Entry> entries;
+        std::deque<std::shared_ptr<const linestore::LineStore>> queue;
+        std::thread builder;
+        std::atomic<bool> stop;
+        unsigned int n_threads;
+        bool index_trigrams;
+        bool index_suffixes;
+        std::string word_delims;
+        bool index_pairs;
+};
+
+/**
+ * Find the lines of a store that may match the filters and fuzzy terms
+ * of a query.
+ *
+ * Only filters that every match passes are used: those of a query
+ * without `|` at its top level, and not negated.  Of these, substring
+ * (`=`), prefix (`^`) and suffix (`$`) filters are looked up in the
+ * suffix arrays (unless the term is in most lines), or else in the
+ * trigram index, or else in the token index (if split by the same
+ * delimiters), and the lines of all of them are intersected.  Then the
+ * lines of blocks that lack an ordered pair of characters of a fuzzy
+ * term are left out.  Other filters and terms that no index can answer
+ * are left to the search.
+ *
+ * @param lines the store that `indexes` are of.
+ * @param fuzzy_terms the fuzzy terms of the query (see
+ *      `fuzzy::Fuzzy::get_queries`).
+ *
+ * @return ids of the lines in increasing order, which are a superset
+ *      of the lines that match, or nothing if the indexes can't
+ *      narrow the lines down and all of them have to be searched.
+*/
+auto find_candidates(const linestore::LineStore& lines, const Indexes& indexes, const filtertree::FilterTree& filter_tree, std::span<const std::string> fuzzy_terms = {}) -> std::optional<std::vector<std::uint32_t>>;
+
+/**
+ * Find the lines of a compressed store that may match the filters of a
+ * query.
+ *
+ * The same filters are used as with the indexes of a store, and are
+ * looked up in the FM-index itself (unless the term occurs more often
+ * than there are lines left), with their case sensitivity, so the lines
+ * found are those that pass them.
+ *
+ * @return ids of the lines in increasing order, or nothing if all of
+ *      them have to be searched.
+*/
+auto find_candidates(const fmindex::Index& lines, const filtertree::FilterTree& filter_tree) -> std::optional<std::vector<std::uint32_t>>;
+
+/**
+ * Find the lines of a store that may match a regex (see
+ * `trigram::Index::find_regex`).
+ *
+ * @return ids of the lines in increasing order, or nothing if all of
+ *      them have to be searched.
+*/
+auto find_regex_candidates(const Indexes& indexes, const std::string& pattern) -> std::optional<std::vector<std::uint32_t>>;
+
+/**
+ * Find the lines of a compressed store that may match a regex.
+ *
+ * The literals of the regex are looked up in the FM-index itself (see
+ * `trigram::find_regex`), unless one occurs in more than a small
+ * fraction of the lines, since extracting the lines of its occurrences
+ * would then cost more than reading the file again.
+ *
+ * @return ids of the lines in increasing order, or nothing if all of
+ *      them have to be searched.
+*/
+auto find_regex_candidates(const fmindex::Index& lines, const std::string& pattern) -> std::optional<std::vector<std::uint32_t>>;
+
+} // namespace lineindex
+
+#endif
@@ -0,0 +1,294 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "linestore.h"
+#include "scheduler.h"
+
+/**
+ * Replace the newlines in `text[beg, end)` with null bytes.
+ *
+ * The offset of the line that follows each newline is appended to
+ * `offsets`.  `text[end - 1]` must be a newline.
+*/
+auto index_lines(char* text, std::size_t beg, std::size_t end, std::vector<std::uint64_t>& offsets) -> void {
+    linestore::for_each_delim(text + beg, end - beg, '\n', [&](const std::size_t j) {
+            text[beg + j] = '\0';
+            offsets.push_back(beg + j + 1);
+            });
+}
+
+/**
+ * Read the bytes `[beg, end)` of a file into `buf`.
+ *
+ * @return number of bytes read (less than `end - beg` at end of
+ *      file), or -1 on error.
+*/
+auto pread_all(int fd, char* buf, std::size_t beg, std::size_t end) -> long {
+    std::size_t n_read = 0;
+    while (beg + n_read < end) {
+        auto n = pread(fd, buf + n_read, end - beg - n_read, beg + n_read);
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        n_read += n;
+    }
+    return n_read;
+}
+
+/**
+ * Append a newline to `text[0, n_read)` if it doesn't end in one.
+ *
+ * @return the new number of bytes.
+*/
+auto terminate_last_line(std::vector<char>& text, std::size_t n_read) -> std::size_t {
+    if ((n_read > 0) && (text[n_read - 1] != '\n')) {
+        if (n_read == text.size()) {
+            text.resize(n_read + 1);
+        }
+        text[n_read] = '\n';
+        ++n_read;
+    }
+    return n_read;
+}
+
+/**
+ * Read a file of known size with `n_threads` threads.
+ *
+ * Each thread reads a range of bytes straight into its place in the
+ * arena and finds the newlines in it.  The ranges don't need to be
+ * aligned to lines, since offsets are positions in the whole arena.
+ *
+ * @return false if the file could not be read whole.
+*/
+auto load_file_parallel(int fd, std::size_t size, unsigned int n_threads, std::vector<char>& text, std::vector<std::uint64_t>& offsets) -> bool {
+    text.resize(size + 1);
+    const auto units = scheduler::make_units({size}, (size + n_threads - 1) / n_threads);
+    auto unit_offsets = std::vector<std::vector<std::uint64_t>>(units.size());
+    auto n_failed = std::atomic<int>(0);
+    scheduler::run(units.size(), n_threads, [&](const auto worker, const auto j) {
+            const auto& unit = units[j];
+            if (std::size_t(pread_all(fd, text.data() + unit.beg, unit.beg, unit.end)) != (unit.end - unit.beg)) {
+                ++n_failed;
+                return;
+            }
+            // Each range indexes up to its own last newline, so a line
+            // running into the next range is ended by a newline found
+            // there.
+            auto last = static_cast<char*>(memrchr(text.data() + unit.beg, '\n', unit.end - unit.beg));
+            if (last != nullptr) {
+                index_lines(text.data(), unit.beg, last - text.data() + 1, unit_offsets[j]);
+            }
+            });
+    if (n_failed > 0) {
+        return false;
+    }
+
+    offsets.clear();
+    offsets.push_back(0);
+    for (const auto& cur_offsets : unit_offsets) {
+        offsets.insert(std::end(offsets), std::cbegin(cur_offsets), std::cend(cur_offsets));
+    }
+
+    // Terminate the last line if it has no trailing newline.
+    if (offsets.back() != size) {
+        text[size] = '\0';
+        offsets.push_back(size + 1);
+    }
+    else {
+        text.resize(size);
+    }
+    return true;
+}
+
+auto linestore::LineStore::index(std::size_t n_bytes) -> void {
+    mapping = nullptr;
+    n_bytes = terminate_last_line(text, n_bytes);
+    text.resize(n_bytes);
+    offsets.clear();
+    offsets.push_back(0);
+    index_lines(text.data(), 0, n_bytes, offsets);
+}
+
+auto linestore::LineStore::unmap() -> void {
+    if (mapping == nullptr) {
+        return;
+    }
+    text.assign(std::cbegin(mapped_text), std::cend(mapped_text));
+    offsets.assign(std::cbegin(mapped_offsets), std::cend(mapped_offsets));
+    mapping = nullptr;
+    mapped_text = std::string_view();
+    mapped_offsets = std::span<const std::uint64_t>();
+}
+
+auto linestore::LineStore::append(const char* line, std::size_t len) -> void {
+    unmap();
+    text.insert(std::end(text), line, line + len);
+    text.push_back('\0');
+    offsets.push_back(text.size());
+}
+
+auto linestore::LineStore::append(const LineStore& other) -> void {
+    unmap();
+    const auto other_text = other.get_text();
+    const auto other_offsets = other.get_offsets();
+    const auto base = text.size();
+    text.insert(std::end(text), std::begin(other_text), std::end(other_text));
+    offsets.reserve(offsets.size() + other.size());
+    for (std::size_t j = 1; j < other_offsets.size(); ++j) {
+        offsets.push_back(base + other_offsets[j]);
+    }
+}
+
+auto linestore::load_file(const std::string& filename, LineStore& store, unsigned int n_threads) -> bool {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    store.name = filename;
+    store.mapping = nullptr;
+
+    // Files like the ones in /proc report a size of 0, so fall back to
+    // growing the arena as needed.
+    struct stat st;
+    bool known_size = (fstat(fd, &st) == 0) && (st.st_size > 0);
+    if (known_size && (n_threads > 1) && (std::size_t(st.st_size) > parallel_load_size)) {
+        if (load_file_parallel(fd, st.st_size, n_threads, store.text, store.offsets)) {
+            close(fd);
+            return true;
+        }
+    }
+
+    std::size_t capacity = known_size ? st.st_size + 1 : 1 << 16;
+    auto& text = store.text;
+    text.resize(capacity);
+    std::size_t n_read = 0;
+    while (true) {
+        if (n_read == text.size()) {
+            text.resize(2 * text.size());
+        }
+        auto n = read(fd, text.data() + n_read, text.size() - n_read);
+        if (n < 0) {
+            close(fd);
+            return false;
+        }
+        if (n == 0) {
+            break;
+        }
+        n_read += n;
+    }
+    close(fd);
+
+    store.index(n_read);
+    return true;
+}
+
+auto linestore::load_buffer(std::vector<char>&& text, std::size_t n_bytes, LineStore& store) -> void {
+    store.text = std::move(text);
+    store.index(n_bytes);
+}
+
+auto linestore::load_mapped(std::shared_ptr<const void> mapping, std::string_view text, std::span<const std::uint64_t> offsets, LineStore& store) -> void {
+    store.text = std::vector<char>();
+    store.offsets = std::vector<std::uint64_t>();
+    store.mapping = std::move(mapping);
+    store.mapped_text = text;
+    store.mapped_offsets = offsets;
+}
+
+auto linestore::split_lines(int fd, std::size_t size, std::size_t chunk_size) -> std::vector<std::pair<std::size_t, std::size_t>> {
+    auto ranges = std::vector<std::pair<std::size_t, std::size_t>>();
+    char window[1 << 12];
+    for (std::size_t beg = 0; beg < size;) {
+        // Move the end of the range forward to just after the next
+        // newline.
+        auto end = std::min(size, beg + std::max(chunk_size, std::size_t(1)));
+        while (end < size) {
+            auto n = pread(fd, window, std::min(sizeof(window), size - end), end);
+            if (n <= 0) {
+                end = size;
+                break;
+            }
+            if (auto newline = static_cast<char*>(memchr(window, '\n', n)); newline != nullptr) {
+                end += newline - window + 1;
+                break;
+            }
+            end += n;
+        }
+        ranges.emplace_back(beg, end);
+        beg = end;
+    }
+    return ranges;
+}
+
+auto linestore::load_range(int fd, std::size_t beg, std::size_t end, LineStore& store) -> bool {
+    auto& text = store.text;
+    text.resize(end - beg + 1);
+    auto n_read = pread_all(fd, text.data(), beg, end);
+    if (n_read < 0) {
+        return false;
+    }
+
+    store.index(n_read);
+    return true;
+}
+
+auto linestore::BlockReader::read_block() -> bool {
+    if (eof) {
+        return false;
+    }
+
+    // Keep the lines not returned yet at the front of the buffer,
+    // growing the buffer if they fill it.
+    auto n_left = end - beg;
+    memmove(buf.data(), buf.data() + beg, n_left);
+    if (n_left == buf.size()) {
+        buf.resize(2 * buf.size());
+    }
+    delims.erase(std::begin(delims), std::begin(delims) + delim_idx);
+    for (auto& pos : delims) {
+        pos -= beg;
+    }
+    delim_idx = 0;
+    beg = 0;
+    end = n_left;
+
+    long n;
+    do {
+        n = read(fd, buf.data() + end, buf.size() - end);
+    } while ((n < 0) && (errno == EINTR));
+    if (n <= 0) {
+        eof = true;
+        return false;
+    }
+
+    for_each_delim(buf.data() + end, n, delim, [&](const std::size_t j) {
+            delims.push_back(end + j);
+            });
+    end += n;
+    return true;
+}
+
+auto linestore::BlockReader::next(std::string_view& line) -> bool {
+    if (delim_idx < delims.size()) {
+        auto pos = delims[delim_idx++];
+        line = std::string_view(buf.data() + beg, pos - beg);
+        beg = pos + 1;
+        return true;
+    }
+    if (eof && (beg < end)) {
+        line = std::string_view(buf.data() + beg, end - beg);
+        beg = end;
+        return true;
+    }
+    return false;
+}
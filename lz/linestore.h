@@ -0,0 +1,299 @@
+#ifndef SUBSEQSEARCH_LINESTORE_H
+#define SUBSEQSEARCH_LINESTORE_H
+
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace linestore {
+
+/**
+ * Files larger than this many bytes are read by several threads when
+ * more than one is available.
+*/
+constexpr std::size_t parallel_load_size = 1 << 24;
+
+/**
+ * Call `f(j)` with the index `j` of every `delim` in `text[0, n)`, in
+ * order.
+ *
+ * With AVX2, 32 bytes are compared to `delim` at once and the indices
+ * are taken from the bits of the resulting mask, so finding all the
+ * delimiters of a block costs about one pass over it regardless of how
+ * short the lines are.
+*/
+template<typename F>
+auto for_each_delim(const char* text, std::size_t n, char delim, F f) -> void {
+    std::size_t j = 0;
+#ifdef __AVX2__
+    const auto needle = _mm256_set1_epi8(delim);
+    for (; (j + 32) <= n; j += 32) {
+        const auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + j));
+        auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle)));
+        while (mask != 0) {
+            f(j + std::countr_zero(mask));
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; j < n; ++j) {
+        if (text[j] == delim) {
+            f(j);
+        }
+    }
+}
+
+/**
+ * Lines read from one source (a file or stdin).
+ *
+ * All lines are stored back to back in a single arena.  Each line
+ * is terminated by the null byte instead of its newline, so a line
+ * can be handed to the `strpbrk` based filters without copying it.
+ *
+ *   name: name of the source (the filename, or empty for stdin).
+ *   text: the arena.
+ *   offsets: `offsets[j]` is the index in `text` where the `j`th
+ *          line starts.  The last element is the size of `text`.
+ *
+ * Instead of owning them, a store can also view an arena and offsets
+ * kept elsewhere, eg. in a mapped snapshot (see `load_mapped`).  Such
+ * a store is copied into its own arena the first time a line is
+ * appended to it.
+*/
+class LineStore {
+
+    public:
+        LineStore() : name(), text(), offsets{0}, mapping(), mapped_text(), mapped_offsets() {}
+
+        /**
+         * @param name name of the source the lines come from.
+        */
+        explicit LineStore(const std::string& name) : name(name), text(), offsets{0}, mapping(), mapped_text(), mapped_offsets() {}
+
+        /**
+         * Append a line.
+         *
+         * @param line the line without its newline.
+         * @param len length of `line`.
+        */
+        auto append(const char* line, std::size_t len) -> void;
+
+        /**
+         * Append all lines of another store, copying its arena and
+         * offsets at once.
+        */
+        auto append(const LineStore& other) -> void;
+
+        /**
+         * @return the `j`th line (not including the null byte).
+        */
+        auto line(std::size_t j) const -> std::string_view {
+            const auto* line_offsets = get_offsets().data();
+            return {get_text().data() + line_offsets[j], line_offsets[j + 1] - line_offsets[j] - 1};
+        }
+
+        /**
+         * @return the `j`th line as a null byte terminated string.
+        */
+        auto c_str(std::size_t j) const -> const char* { return get_text().data() + get_offsets()[j]; }
+
+        /**
+         * @return number of lines.
+        */
+        auto size() const -> std::size_t { return get_offsets().size() - 1; }
+
+        /**
+         * @return number of bytes in the arena.
+        */
+        auto n_bytes() const -> std::size_t { return get_text().size(); }
+
+        /**
+         * @return the arena.
+        */
+        auto get_text() const -> std::string_view {
+            return (mapping == nullptr) ? std::string_view(text.data(), text.size()) : mapped_text;
+        }
+
+        /**
+         * @return the offsets of the lines in the arena, followed by
+         *      the size of the arena.
+        */
+        auto get_offsets() const -> std::span<const std::uint64_t> {
+            return (mapping == nullptr) ? std::span<const std::uint64_t>(offsets) : mapped_offsets;
+        }
+
+        /**
+         * @return name of the source the lines come from.
+        */
+        auto get_name() const -> const std::string& { return name; }
+
+        /**
+         * @param name new name of the source the lines come from.
+        */
+        auto set_name(const std::string& name) -> void { this->name = name; }
+
+    private:
+        friend auto load_file(const std::string& filename, LineStore& store, unsigned int n_threads) -> bool;
+        friend auto load_range(int fd, std::size_t beg, std::size_t end, LineStore& store) -> bool;
+        friend auto load_buffer(std::vector<char>&& text, std::size_t n_bytes, LineStore& store) -> void;
+        friend auto load_mapped(std::shared_ptr<const void> mapping, std::string_view text, std::span<const std::uint64_t> offsets, LineStore& store) -> void;
+
+        /**
+         * Split the first `n_bytes` bytes of the arena into lines.
+        */
+        auto index(std::size_t n_bytes) -> void;
+
+        /**
+         * Copy the viewed arena and offsets into the store's own, so
+         * that lines can be added.
+        */
+        auto unmap() -> void;
+
+        std::string name;
+        std::vector<char> text;
+        std::vector<std::uint64_t> offsets;
+        std::shared_ptr<const void> mapping;
+        std::string_view mapped_text;
+        std::span<const std::uint64_t> mapped_offsets;
+};
+
+/**
+ * Read all lines of a file into `store`.
+ *
+ * The file is read with one `read` call per block, directly into the
+ * arena, and newlines are replaced in place.  As with `std::getline`,
+ * a trailing newline does not produce an empty last line.
+ *
+ * Files larger than `parallel_load_size` are read with `pread` by
+ * `n_threads` threads, each filling and indexing its own range of the
+ * arena.
+ *
+ * @param filename file to read.
+ * @param store store to fill.  Its name is set to `filename`.
+ * @param n_threads number of threads to read large files with.
+ *
+ * @return false if the file could not be read, true otherwise.
+*/
+auto load_file(const std::string& filename, LineStore& store, unsigned int n_threads = 1) -> bool;
+
+/**
+ * Split the bytes `[0, size)` of a file into ranges of whole lines.
+ *
+ * Each range is about `chunk_size` bytes.  It is extended to just
+ * after the next newline, so that ranges can be read and searched
+ * independently.
+ *
+ * @return `(beg, end)` byte ranges in file order.
+*/
+auto split_lines(int fd, std::size_t size, std::size_t chunk_size) -> std::vector<std::pair<std::size_t, std::size_t>>;
+
+/**
+ * Read the lines in the bytes `[beg, end)` of a file into `store`.
+ *
+ * The contents of `store` are replaced, but not its name.  `beg`
+ * should be the start of a line (see `split_lines`).  Line `j` of the
+ * store is line `j` of the range, so callers have to add the number
+ * of lines before `beg` to get line numbers in the file.
+ *
+ * @return false if the range could not be read, true otherwise.
+*/
+auto load_range(int fd, std::size_t beg, std::size_t end, LineStore& store) -> bool;
+
+/**
+ * Replace the contents of `store` with the lines in `text[0, n_bytes)`.
+ *
+ * This is for readers that fill their own buffers (see
+ * `batchreader`).  `text` becomes the arena, so its lines are split
+ * in place without copying.
+*/
+auto load_buffer(std::vector<char>&& text, std::size_t n_bytes, LineStore& store) -> void;
+
+/**
+ * Make `store` a view of an arena and offsets kept elsewhere (eg. in
+ * a mapped snapshot), without copying them.
+ *
+ * The contents of `store` are replaced, but not its name.  `text` and
+ * `offsets` must be laid out as in a store (see `LineStore`), and
+ * stay valid as long as `mapping` does.  The store keeps a reference
+ * to `mapping`.
+*/
+auto load_mapped(std::shared_ptr<const void> mapping, std::string_view text, std::span<const std::uint64_t> offsets, LineStore& store) -> void;
+
+/**
+ * Reads lines from a file descriptor (eg. a pipe) in large blocks.
+ *
+ * Each block is read with one `read` call, and all of its delimiters
+ * are found at once with `for_each_delim`.  Lines are returned as
+ * views into the block, so nothing is copied per line.  As with
+ * `std::getline`, a trailing delimiter does not produce an empty last
+ * line.
+*/
+class BlockReader {
+
+    public:
+        /**
+         * @param fd file descriptor to read.  It is not closed by the
+         *      reader.
+         * @param delim byte that ends lines (`'\0'` for null
+         *      separated input).
+         * @param block_size number of bytes to read at once.
+        */
+        explicit BlockReader(int fd, char delim = '\n', std::size_t block_size = 1 << 16)
+            : fd(fd), delim(delim), buf(block_size), beg(0), end(0), delims(), delim_idx(0), eof(false) {}
+
+        /**
+         * Read the next block.
+         *
+         * This blocks until data is available.  The lines it completes
+         * are returned by `next`.
+         *
+         * @return false at the end of the input (or on error).
+        */
+        auto read_block() -> bool;
+
+        /**
+         * Get the next line of the blocks read so far.
+         *
+         * @param line set to the line without its delimiter.  It is
+         *      valid until the next call to `read_block`.
+         *
+         * @return false if there is no complete line left.
+        */
+        auto next(std::string_view& line) -> bool;
+
+        /**
+         * Get the next line, reading blocks as needed.
+         *
+         * @return false at the end of the input.
+        */
+        auto read_line(std::string_view& line) -> bool {
+            while (!next(line)) {
+                if (!read_block()) {
+                    return next(line);
+                }
+            }
+            return true;
+        }
+
+    private:
+        int fd;
+        char delim;
+        std::vector<char> buf;
+        std::size_t beg;
+        std::size_t end;
+        std::vector<std::uint32_t> delims;
+        std::size_t delim_idx;
+        bool eof;
+};
+
+} // namespace linestore
+
+#endif
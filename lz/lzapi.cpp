@@ -14,10 +14,10 @@ auto _fill_batch(std::vector<std::vector<MatchInfo>>& strings, const std::vector
     for (int count = 0; count < batch_size; ++count) {
         for (int j = 0; j < n_threads; ++j) {
             if (offset >= n_items) {
-                // TODO: return -1.
-                return offset + 1;
+                return offset;
             }
-            strings[j].push_back(MatchInfo{.text=items[offset], .filename=filename, .lineno=offset});
+            // Line numbers start at 1, as in `_search`.
+            strings[j].push_back(MatchInfo{.text=items[offset], .filename=filename, .lineno=offset + 1});
             ++offset;
         }
     }
@@ -26,24 +26,58 @@ auto _fill_batch(std::vector<std::vector<MatchInfo>>& strings, const std::vector
 
 /**
 */
-auto _fill_batch(std::vector<std::vector<MatchInfo>>& strings, std::istream& is, int batch_size, int offset, const std::string& filename) -> int {
+auto _fill_batch(std::vector<std::vector<MatchInfo>>& strings, linestore::BlockReader& reader, int batch_size, int offset, const std::string& filename) -> int {
     auto n_threads = strings.size();
     for (int j = 0; j < n_threads; ++j) {
         strings[j].clear();
     }
-    std::string line;
+    auto line = std::string_view();
     for (int count = 0; count < batch_size; ++count) {
         for (int j = 0; j < n_threads; ++j) {
-            if (!std::getline(is, line)) {
+            if (!reader.read_line(line)) {
                 return -1;
             }
-            strings[j].push_back(MatchInfo{.text=line, .filename=filename, .lineno=offset});
+            strings[j].push_back(MatchInfo{.text=std::string(line), .filename=filename, .lineno=offset});
             ++offset;
         }
     }
     return offset;
 }
 
+/**
+*/
+auto _split_by_size(const std::vector<std::string>& filenames, std::uintmax_t max_size) -> std::pair<std::vector<std::string>, std::vector<std::string>> {
+    auto small_files = std::vector<std::string>();
+    auto large_files = std::vector<std::string>();
+    for (const auto& filename : filenames) {
+        auto ec = std::error_code();
+        auto size = filename.empty() ? 0 : std::filesystem::file_size(filename, ec);
+        if (filename.empty() || ec || (size > max_size)) {
+            large_files.push_back(filename);
+        }
+        else {
+            small_files.push_back(filename);
+        }
+    }
+    return {small_files, large_files};
+}
+
+/**
+*/
+auto _add_chunk_scores(const std::vector<scheduler::WorkUnit>& units, const std::vector<std::size_t>& chunk_n_lines, std::vector<std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>>>& chunk_scores, std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>>& scores, int topk) -> void {
+    std::size_t lines_before = 0;
+    for (std::size_t j = 0; j < units.size(); ++j) {
+        if ((j > 0) && (units[j].source != units[j - 1].source)) {
+            lines_before = 0;
+        }
+        for (auto& [score, match_info] : chunk_scores[j]) {
+            match_info.lineno += lines_before;
+            _add_score(scores, topk, std::move(score), match_info);
+        }
+        lines_before += chunk_n_lines[j];
+    }
+}
+
 /**
  * Initialize `n` score vectors.
 */
@@ -86,6 +120,27 @@ auto _add_score(std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>>& scores,
     }
 }
 
+/**
+*/
+auto _merge_scores(const std::vector<std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>>>& thread_scores) -> std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>> {
+    auto n_scores = std::size_t(0);
+    for (const auto& scores : thread_scores) {
+        n_scores += scores.size();
+    }
+    auto best_scores = std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>>();
+    best_scores.reserve(n_scores);
+    for (const auto& scores : thread_scores) {
+        for (const auto& score : scores) {
+            best_scores.push_back(score);
+        }
+    }
+    std::sort(
+            std::execution::par,
+            std::begin(best_scores), std::end(best_scores),
+            _comparator);
+    return best_scores;
+}
+
 auto set_case_if_smart(qdata::SearchArgs& search_args) -> void {
     if (!search_args.smart_case) {
         return;
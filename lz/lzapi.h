@@ -2,18 +2,31 @@
 #define LAZYAPI_H
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <chrono>
 #include <execution>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "fmindex.h"
+#include "lineindex.h"
+#include "linestore.h"
 #include "querydata.h"
 #include "query_parser.h"
 #include "fuzzy.h"
+#include "scheduler.h"
 #include "scores.h"
 
 namespace lz {
@@ -44,14 +57,84 @@ struct MatchInfo {
 };
 
 auto _create_scores(int n, int topk) -> std::vector<std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>>>;
+/**
+ * Split filenames into files small enough to be read whole by one
+ * worker, and the rest.
+ *
+ * Stdin (an empty filename) and files whose size can't be determined
+ * are counted as large.
+ *
+ * @return `(small files, large files)`.
+*/
+auto _split_by_size(const std::vector<std::string>& filenames, std::uintmax_t max_size) -> std::pair<std::vector<std::string>, std::vector<std::string>>;
+/**
+ * Add the scores of ranges of files to a heap.
+ *
+ * Line numbers in `chunk_scores[j]` are relative to `units[j]`.  They
+ * are made relative to the file by adding the number of lines in the
+ * ranges of the same file that come before it.
+ *
+ * @param units ranges in file order.
+ * @param chunk_n_lines number of lines in each range.
+ * @param chunk_scores heap of each range.  Its elements are moved.
+ * @param scores heap to add to.
+*/
+auto _add_chunk_scores(const std::vector<scheduler::WorkUnit>& units, const std::vector<std::size_t>& chunk_n_lines, std::vector<std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>>>& chunk_scores, std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>>& scores, int topk) -> void;
 auto _fill_batch(std::vector<std::vector<MatchInfo>>& strings, const std::vector<std::string>& items, int batch_size, int offset, const std::string& filename = "") -> int;
-auto _fill_batch(std::vector<std::vector<MatchInfo>>& strings, std::istream& is, int batch_size, int offset, const std::string& filename = "") -> int;
+auto _fill_batch(std::vector<std::vector<MatchInfo>>& strings, linestore::BlockReader& reader, int batch_size, int offset, const std::string& filename = "") -> int;
 
 /**
  * Set case if using smart case.
 */
 auto set_case_if_smart(qdata::SearchArgs& search_args) -> void;
 auto _add_score(std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>>& scores, int topk, fuzzy::ScoreResults&& score, const MatchInfo& match_info) -> void;
+/**
+ * Aggregate thread-specific scores into a single vector and sort it.
+*/
+auto _merge_scores(const std::vector<std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>>>& thread_scores) -> std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>>;
+
+/**
+ * Called with the best matches found so far while a search runs,
+ * sorted as the final results are.
+*/
+using ProgressCallback = std::function<void (std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>>&&)>;
+
+/**
+ * Default time between two calls of a `ProgressCallback`.
+*/
+constexpr auto default_progress_interval = std::chrono::milliseconds(100);
+
+/**
+ * Decides when a search reports its progress.
+ *
+ * Searches check `is_due` between batches of lines, so the callback
+ * is called at most once per `interval`, and less often if batches
+ * take longer.  The time of the next report is atomic, so that workers
+ * can check it without taking a lock.
+*/
+struct _Progress {
+    ProgressCallback on_progress;
+    std::chrono::milliseconds interval;
+    std::atomic<std::chrono::steady_clock::time_point> next;
+
+    _Progress(const ProgressCallback& on_progress, std::chrono::milliseconds interval)
+        : on_progress(on_progress), interval(interval), next(std::chrono::steady_clock::now() + interval) {}
+
+    /**
+     * @return true if progress should be reported now.
+    */
+    auto is_due() const -> bool {
+        return on_progress && (std::chrono::steady_clock::now() >= next.load(std::memory_order_relaxed));
+    }
+
+    /**
+     * Call the callback with `scores`.
+    */
+    auto report(std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>>&& scores) -> void {
+        next.store(std::chrono::steady_clock::now() + interval, std::memory_order_relaxed);
+        on_progress(std::move(scores));
+    }
+};
 
 /**
 */
@@ -68,16 +151,200 @@ auto _find_match(const MatchInfo& line, const qparse::Query<Scorer>& query, std:
     return true;
 }
 
+/**
+ * Files larger than this many bytes are not read whole by a single
+ * worker.
+*/
+constexpr std::uintmax_t _large_file_size = 1 << 23;
+
+/**
+ * Number of lines searched between checks of `SearchArgs::cancel`.
+ *
+ * Even slow queries get through this many lines in well under a
+ * millisecond.
+*/
+constexpr std::size_t cancel_interval = 1 << 10;
+
+/**
+ * @return true if the search was cancelled (see `SearchArgs::cancel`).
+*/
+inline auto _is_cancelled(const qdata::SearchArgs& search_args) -> bool {
+    return (search_args.cancel != nullptr) && search_args.cancel->load(std::memory_order_relaxed);
+}
+
+/**
+ * Parse one query per worker.
+ *
+ * Queries hold scratch space used while scoring, so workers can't
+ * share them.
+*/
+template<typename Scorer>
+auto _create_queries(int n, const qdata::SearchArgs& search_args) -> std::vector<qparse::Query<Scorer>> {
+    auto queries = std::vector<qparse::Query<Scorer>>();
+    queries.reserve(n);
+    for (int j = 0; j < n; ++j) {
+        queries.emplace_back(qparse::getparse<Scorer>(search_args));
+    }
+    return queries;
+}
+
+/**
+ * Search the lines `[beg, end)` of a store for query matches.
+*/
+template<typename Scorer>
+auto _search(const qparse::Query<Scorer>& query, const qdata::SearchArgs& search_args, std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>>& scores, const linestore::LineStore& lines, std::size_t beg, std::size_t end) -> void {
+    auto match_info = MatchInfo{"", lines.get_name(), 0};
+    for (auto block_beg = beg; (block_beg < end) && !_is_cancelled(search_args); block_beg += cancel_interval) {
+        const auto block_end = std::min(end, block_beg + cancel_interval);
+        for (auto j = block_beg; j < block_end; ++j) {
+            match_info.lineno = j + 1;
+            match_info.text = lines.line(j);
+            _find_match(match_info, query, scores, search_args.topk);
+        }
+    }
+}
+
+/**
+ * Search the lines `[beg, end)` of a store that are in `candidates`
+ * for query matches.
+ *
+ * @param candidates ids of lines in increasing order (see
+ *      `_find_candidates`).
+*/
+template<typename Scorer>
+auto _search(const qparse::Query<Scorer>& query, const qdata::SearchArgs& search_args, std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>>& scores, const linestore::LineStore& lines, std::size_t beg, std::size_t end, const std::vector<std::uint32_t>& candidates) -> void {
+    auto match_info = MatchInfo{"", lines.get_name(), 0};
+    auto it = std::ranges::lower_bound(candidates, beg);
+    for (std::size_t n_searched = 0; (it != std::end(candidates)) && (*it < end); ++it, ++n_searched) {
+        if ((n_searched % cancel_interval == 0) && _is_cancelled(search_args)) {
+            break;
+        }
+        match_info.lineno = *it + 1;
+        match_info.text = lines.line(*it);
+        _find_match(match_info, query, scores, search_args.topk);
+    }
+}
+
+/**
+ * @return the fuzzy terms of a query, each of which a matching line
+ *      has as a subsequence.
+*/
+template<typename Scorer>
+auto get_fuzzy_terms(const qparse::Query<Scorer>& query) -> std::vector<std::string> {
+    auto terms = std::vector<std::string>();
+    for (const auto& qdata : query.fuzzy->get_queries()) {
+        terms.push_back(qdata.q);
+    }
+    return terms;
+}
+
+/**
+ * Find the lines of each store that may match a query, using the
+ * indexes of `search_args.indexer`.
+ *
+ * @return for each store, the ids of the lines to search, or nothing
+ *      if all of them have to be.
+*/
+template<typename Scorer>
+auto _find_candidates(const qparse::Query<Scorer>& query, const qdata::SearchArgs& search_args, const std::vector<std::shared_ptr<const linestore::LineStore>>& stores) -> std::vector<std::optional<std::vector<std::uint32_t>>> {
+    auto candidates = std::vector<std::optional<std::vector<std::uint32_t>>>(stores.size());
+    if (search_args.indexer == nullptr) {
+        return candidates;
+    }
+    const auto fuzzy_terms = get_fuzzy_terms(query);
+    for (std::size_t j = 0; (j < stores.size()) && !_is_cancelled(search_args); ++j) {
+        candidates[j] = lineindex::find_candidates(*stores[j], search_args.indexer->get(*stores[j]), *query.filter_tree, fuzzy_terms);
+    }
+    return candidates;
+}
+
+/**
+ * Find the lines of each compressed store that may match a query,
+ * using the stores themselves.
+ *
+ * @return for each store, the ids of the lines to search, or nothing
+ *      if all of them have to be.
+*/
+template<typename Scorer>
+auto _find_candidates(const qparse::Query<Scorer>& query, const qdata::SearchArgs& search_args, const std::vector<std::shared_ptr<const fmindex::Index>>& stores) -> std::vector<std::optional<std::vector<std::uint32_t>>> {
+    auto candidates = std::vector<std::optional<std::vector<std::uint32_t>>>(stores.size());
+    for (std::size_t j = 0; (j < stores.size()) && !_is_cancelled(search_args); ++j) {
+        candidates[j] = lineindex::find_candidates(*stores[j], *query.filter_tree);
+    }
+    return candidates;
+}
+
+/**
+ * Search a unit of a store, going through its candidates only if
+ * there are any (see `_find_candidates`).
+*/
+template<typename Scorer>
+auto _search(const qparse::Query<Scorer>& query, const qdata::SearchArgs& search_args, std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>>& scores, const linestore::LineStore& lines, const scheduler::WorkUnit& unit, const std::optional<std::vector<std::uint32_t>>& candidates) -> void {
+    if (candidates) {
+        _search<Scorer>(query, search_args, scores, lines, unit.beg, unit.end, *candidates);
+    }
+    else {
+        _search<Scorer>(query, search_args, scores, lines, unit.beg, unit.end);
+    }
+}
+
+/**
+ * Search a unit of a compressed store, going through its candidates
+ * only if there are any (see `_find_candidates`).
+ *
+ * Extracting a line costs about as much as going through it in the
+ * FM-index, so lines are only extracted once the fuzzy terms are found
+ * in them there.
+*/
+template<typename Scorer>
+auto _search(const qparse::Query<Scorer>& query, const qdata::SearchArgs& search_args, std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>>& scores, const fmindex::Index& lines, const scheduler::WorkUnit& unit, const std::optional<std::vector<std::uint32_t>>& candidates) -> void {
+    const auto patterns = get_fuzzy_terms(query);
+    auto match_info = MatchInfo{"", lines.get_name(), 0};
+    const auto search_line = [&](const std::size_t j) {
+        if (lines.has_subsequences(j, patterns, search_args.ignore_case)) {
+            match_info.lineno = j + 1;
+            match_info.text = lines.line(j);
+            _find_match(match_info, query, scores, search_args.topk);
+        }
+    };
+
+    if (candidates) {
+        auto it = std::ranges::lower_bound(*candidates, unit.beg);
+        for (std::size_t n_searched = 0; (it != std::end(*candidates)) && (*it < unit.end); ++it, ++n_searched) {
+            if ((n_searched % cancel_interval == 0) && _is_cancelled(search_args)) {
+                break;
+            }
+            search_line(*it);
+        }
+    }
+    else {
+        for (auto j = unit.beg; j < unit.end; ++j) {
+            if (((j - unit.beg) % cancel_interval == 0) && _is_cancelled(search_args)) {
+                break;
+            }
+            search_line(j);
+        }
+    }
+}
+
 /**
  * Search a vector for query matches.
 */
 template<typename Scorer>
-auto _search(const qdata::SearchArgs& search_args, std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>>& scores, const std::vector<std::string>& lines) -> void {
+auto _search(const qdata::SearchArgs& search_args, std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>>& scores, const std::vector<std::string>& lines, _Progress& progress) -> void {
     // TODO: do this once and copy to each thread.
     const auto query = qparse::getparse<Scorer>(search_args);
     int n_matches = 0;
     auto match_info = MatchInfo{"", "", 0};
     for (const auto& line : lines) {
+        if (match_info.lineno % cancel_interval == 0) {
+            if (_is_cancelled(search_args)) {
+                break;
+            }
+            if (progress.is_due()) {
+                progress.report(_merge_scores({scores}));
+            }
+        }
         match_info.lineno += 1;
         match_info.text = line;
         n_matches += _find_match(match_info, query, scores, search_args.topk);
@@ -94,8 +361,11 @@ auto _search(const qdata::SearchArgs& search_args, std::vector<std::pair<fuzzy::
     // TODO: do this once and copy to each thread.
     const auto query = qparse::getparse<Scorer>(search_args);
     int n_matches = 0;
-    for (const auto& line : lines) {
-        n_matches += _find_match(line, query, scores, search_args.topk);
+    for (std::size_t j = 0; j < lines.size(); ++j) {
+        if ((j % cancel_interval == 0) && _is_cancelled(search_args)) {
+            break;
+        }
+        n_matches += _find_match(lines[j], query, scores, search_args.topk);
     }
 
     //std::cout << n_matches << std::endl;
@@ -106,17 +376,17 @@ auto _search(const qdata::SearchArgs& search_args, std::vector<std::pair<fuzzy::
  *
  * @param search_args search args.
  * @param scores container in which to add scores of matches.
- * @param is input stream of newline-separated lines to search over.
- * @param end the byte of the stream to stop reading at.  If this is
- *      less than 1, then reading will continue until the end of file.
+ * @param reader reader of the newline-separated lines to search over.
 */
 template<typename Scorer>
-auto _search(const qdata::SearchArgs& search_args, std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>>& scores, std::basic_istream<char>& is, const std::string& filename) -> void {
+auto _search(const qdata::SearchArgs& search_args, std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>>& scores, linestore::BlockReader& reader, const std::string& filename) -> void {
     const auto query = qparse::getparse<Scorer>(search_args);
-    std::string line;
     int n_matches = 0;
     auto match_info = MatchInfo{"", filename, 0};
-    while (std::getline(is, line)) {
+    for (auto line = std::string_view(); reader.read_line(line);) {
+        if ((match_info.lineno % cancel_interval == 0) && _is_cancelled(search_args)) {
+            break;
+        }
         match_info.text = line;
         match_info.lineno += 1;
         n_matches += _find_match(match_info, query, scores, search_args.topk);
@@ -136,17 +406,17 @@ auto _search(const qdata::SearchArgs& search_args, std::vector<std::pair<fuzzy::
 template<typename Scorer>
 auto _start_search(const qdata::SearchArgs& search_args, std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>>& scores, const std::string& filename) -> void {
     bool using_cin = filename.empty();
-    std::ifstream fis = std::ifstream(filename);
-    auto& is = using_cin ? std::cin : fis;
-
-    // This makes reading from stdin fast.
-    if (using_cin) {
-        std::ios::sync_with_stdio(false);
+    int fd = using_cin ? STDIN_FILENO : open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
     }
 
-    _search<Scorer>(search_args, scores, is, filename);
+    auto reader = linestore::BlockReader(fd);
+    _search<Scorer>(search_args, scores, reader, filename);
 
-    fis.close();
+    if (!using_cin) {
+        close(fd);
+    }
 }
 
 /**
@@ -156,6 +426,9 @@ template<typename Scorer>
 auto single_threaded_search(const qdata::SearchArgs& search_args) -> std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>> {
     auto scores = _create_scores(1, search_args.topk)[0];
     for (const auto& filename : search_args.filenames) {
+        if (_is_cancelled(search_args)) {
+            break;
+        }
         _start_search<Scorer>(search_args, scores, filename);
     }
     std::ranges::sort(scores, _comparator);
@@ -164,20 +437,232 @@ auto single_threaded_search(const qdata::SearchArgs& search_args) -> std::vector
 
 /**
  * Search using one thread only.
+ *
+ * @param on_progress called every `progress_interval` with the best
+ *      matches so far, if not empty.
 */
 template<typename Scorer>
-auto single_threaded_search(const qdata::SearchArgs& search_args, const std::vector<std::string>& lines) -> std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>> {
+auto single_threaded_search(const qdata::SearchArgs& search_args, const std::vector<std::string>& lines, const ProgressCallback& on_progress = nullptr, std::chrono::milliseconds progress_interval = default_progress_interval) -> std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>> {
     auto scores = _create_scores(1, search_args.topk)[0];
-    _search<Scorer>(search_args, scores, lines);
+    auto progress = _Progress(on_progress, progress_interval);
+    _search<Scorer>(search_args, scores, lines, progress);
+    std::ranges::sort(scores, _comparator);
+    return scores;
+}
+
+/**
+ * Search the given lines of stores using one thread only.
+ *
+ * @param candidates for each store, the ids of the lines to search in
+ *      increasing order, or nothing to search all of them.
+*/
+template<typename Scorer, typename Store>
+auto single_threaded_search(const qdata::SearchArgs& search_args, const std::vector<std::shared_ptr<const Store>>& stores, const std::vector<std::optional<std::vector<std::uint32_t>>>& candidates, const ProgressCallback& on_progress = nullptr, std::chrono::milliseconds progress_interval = default_progress_interval) -> std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>> {
+    auto scores = _create_scores(1, search_args.topk)[0];
+    const auto query = qparse::getparse<Scorer>(search_args);
+    auto progress = _Progress(on_progress, progress_interval);
+
+    auto sizes = std::vector<std::size_t>();
+    sizes.reserve(stores.size());
+    for (const auto& store : stores) {
+        sizes.push_back(store->size());
+    }
+    for (const auto& unit : scheduler::make_units(sizes, search_args.batch_size)) {
+        _search<Scorer>(query, search_args, scores, *stores[unit.source], unit, candidates[unit.source]);
+        if (progress.is_due() && !_is_cancelled(search_args)) {
+            progress.report(_merge_scores({scores}));
+        }
+    }
     std::ranges::sort(scores, _comparator);
     return scores;
 }
 
+/**
+ * Search stores (`linestore::LineStore` or `fmindex::Index`) using one
+ * thread only.
+ *
+ * Stores are searched in chunks of `batch_size` lines, so that
+ * progress can be reported between them.
+ *
+ * @param on_progress called every `progress_interval` with the best
+ *      matches so far, if not empty.
+*/
+template<typename Scorer, typename Store>
+auto single_threaded_search(const qdata::SearchArgs& search_args, const std::vector<std::shared_ptr<const Store>>& stores, const ProgressCallback& on_progress = nullptr, std::chrono::milliseconds progress_interval = default_progress_interval) -> std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>> {
+    const auto candidates = _find_candidates(qparse::getparse<Scorer>(search_args), search_args, stores);
+    return single_threaded_search<Scorer>(search_args, stores, candidates, on_progress, progress_interval);
+}
+
+/**
+ * Search large files by ranges of whole lines.
+ *
+ * Each file is split into ranges of about `_large_file_size` bytes
+ * that end in a newline.  Workers read a range with `pread` and search
+ * it on their own, keeping a separate heap per range with line
+ * numbers relative to the range.  Afterwards, line numbers are made
+ * relative to the file using the number of lines in the ranges before
+ * it, and the heaps are merged into `scores`.
+ *
+ * @param stores one scratch store per worker.
+ *
+ * @return files that can't be split (stdin, pipes, etc.), which
+ *      still need to be searched.
+*/
+template<typename Scorer>
+auto _search_chunks(const qdata::SearchArgs& search_args, const std::vector<std::string>& filenames, const std::vector<qparse::Query<Scorer>>& queries, std::vector<linestore::LineStore>& stores, std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>>& scores) -> std::vector<std::string> {
+    auto streamed_files = std::vector<std::string>();
+    auto chunked_files = std::vector<std::string>();
+    auto fds = std::vector<int>();
+    auto units = std::vector<scheduler::WorkUnit>();
+    for (const auto& filename : filenames) {
+        int fd = filename.empty() ? -1 : open(filename.c_str(), O_RDONLY);
+        struct stat st;
+        if ((fd < 0) || (fstat(fd, &st) != 0) || !S_ISREG(st.st_mode)) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            streamed_files.push_back(filename);
+            continue;
+        }
+        for (const auto& [beg, end] : linestore::split_lines(fd, st.st_size, _large_file_size)) {
+            units.push_back(scheduler::WorkUnit{.source=fds.size(), .beg=beg, .end=end});
+        }
+        fds.push_back(fd);
+        chunked_files.push_back(filename);
+    }
+
+    auto chunk_scores = std::vector<std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>>>(units.size());
+    auto chunk_n_lines = std::vector<std::size_t>(units.size(), 0);
+    scheduler::run(units.size(), stores.size(), [&](const auto worker, const auto j) {
+            if (_is_cancelled(search_args)) {
+                return;
+            }
+            const auto& unit = units[j];
+            auto& store = stores[worker];
+            store.set_name(chunked_files[unit.source]);
+            if (linestore::load_range(fds[unit.source], unit.beg, unit.end, store)) {
+                chunk_n_lines[j] = store.size();
+                _search<Scorer>(queries[worker], search_args, chunk_scores[j], store, 0, store.size());
+            }
+            });
+    for (const auto fd : fds) {
+        close(fd);
+    }
+
+    _add_chunk_scores(units, chunk_n_lines, chunk_scores, scores, search_args.topk);
+    return streamed_files;
+}
+
+/**
+ * Search the given lines of stores using all threads.
+ *
+ * @param candidates for each store, the ids of the lines to search in
+ *      increasing order, or nothing to search all of them.
+*/
+template<typename Scorer, typename Store>
+auto multi_threaded_search(const qdata::SearchArgs& search_args, const std::vector<std::shared_ptr<const Store>>& stores, const std::vector<std::optional<std::vector<std::uint32_t>>>& candidates, const ProgressCallback& on_progress = nullptr, std::chrono::milliseconds progress_interval = default_progress_interval) -> std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>> {
+    unsigned int n_threads = std::thread::hardware_concurrency();
+    auto thread_scores = _create_scores(n_threads, search_args.topk);
+    const auto queries = _create_queries<Scorer>(n_threads, search_args);
+
+    auto sizes = std::vector<std::size_t>();
+    sizes.reserve(stores.size());
+    for (const auto& store : stores) {
+        sizes.push_back(store->size());
+    }
+    const auto units = scheduler::make_units(sizes, search_args.batch_size);
+    auto progress = _Progress(on_progress, progress_interval);
+    const int n_progress = on_progress ? n_threads : 0;
+    auto progress_scores = _create_scores(n_progress, search_args.topk);
+    auto progress_mutexes = std::vector<std::mutex>(n_progress);
+    auto snapshot_due = std::vector<std::chrono::steady_clock::time_point>(n_progress);
+    auto report_mutex = std::mutex();
+    scheduler::run(units.size(), n_threads, [&](const auto worker, const auto j) {
+            const auto& unit = units[j];
+            _search<Scorer>(queries[worker], search_args, thread_scores[worker], *stores[unit.source], unit, candidates[unit.source]);
+            if (!on_progress) {
+                return;
+            }
+            if (const auto now = std::chrono::steady_clock::now(); now >= snapshot_due[worker]) {
+                auto lock = std::lock_guard(progress_mutexes[worker]);
+                progress_scores[worker] = thread_scores[worker];
+                snapshot_due[worker] = now + progress_interval / 2;
+            }
+            if (!progress.is_due()) {
+                return;
+            }
+            auto report_lock = std::unique_lock(report_mutex, std::try_to_lock);
+            if (report_lock && progress.is_due() && !_is_cancelled(search_args)) {
+                auto snapshots = std::vector<std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>>>(n_progress);
+                for (int k = 0; k < n_progress; ++k) {
+                    auto lock = std::lock_guard(progress_mutexes[k]);
+                    snapshots[k] = progress_scores[k];
+                }
+                progress.report(_merge_scores(snapshots));
+            }
+            });
+
+    return _merge_scores(thread_scores);
+}
+
+/**
+ * Search stores (`linestore::LineStore` or `fmindex::Index`) using all
+ * threads.
+ *
+ * Stores with at most `batch_size` lines are searched whole by one
+ * worker; larger ones are split into chunks of `batch_size` lines.
+ * Workers take the next chunk as soon as they finish one, so many
+ * small stores don't cost a synchronization each.  Only the lines
+ * left by the indexes are searched (see `_find_candidates`).
+ *
+ * To report progress, workers copy their heap after a chunk every half
+ * `progress_interval`, since the heaps of the other workers are still
+ * changing, and each copy has its own lock.  The first worker to find
+ * that progress is due (without locking, see `_Progress`) and to take
+ * the report lock merges the copies and calls `on_progress`, while
+ * the others go on searching instead of waiting for it.  So it is
+ * called from the workers, one at a time, with matches that are at
+ * most about half an interval old.
+ *
+ * @param on_progress called every `progress_interval` with the best
+ *      matches so far, if not empty.
+*/
+template<typename Scorer, typename Store>
+auto multi_threaded_search(const qdata::SearchArgs& search_args, const std::vector<std::shared_ptr<const Store>>& stores, const ProgressCallback& on_progress = nullptr, std::chrono::milliseconds progress_interval = default_progress_interval) -> std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>> {
+    const auto candidates = _find_candidates(qparse::getparse<Scorer>(search_args), search_args, stores);
+    return multi_threaded_search<Scorer>(search_args, stores, candidates, on_progress, progress_interval);
+}
+
+/**
+ * Search files using all threads.
+ *
+ * Small files are read and searched whole by one worker each, with
+ * workers taking the next file as soon as they finish one.  Large
+ * files are split into ranges of whole lines that workers read with
+ * `pread` and search independently (see `_search_chunks`).  Stdin and
+ * other streams are read in batches that are split among all
+ * workers.
+*/
 template<typename Scorer>
 auto multi_threaded_search(const qdata::SearchArgs& search_args) -> std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>> {
     unsigned int n_threads = std::thread::hardware_concurrency();
     auto thread_scores = _create_scores(n_threads, search_args.topk);
 
+    const auto [small_files, large_files] = _split_by_size(search_args.filenames, _large_file_size);
+    const auto queries = _create_queries<Scorer>(n_threads, search_args);
+    auto stores = std::vector<linestore::LineStore>(n_threads);
+    scheduler::run(small_files.size(), n_threads, [&](const auto worker, const auto j) {
+            if (_is_cancelled(search_args)) {
+                return;
+            }
+            auto& store = stores[worker];
+            if (linestore::load_file(small_files[j], store)) {
+                _search<Scorer>(queries[worker], search_args, thread_scores[worker], store, 0, store.size());
+            }
+            });
+
+    const auto streamed_files = _search_chunks<Scorer>(search_args, large_files, queries, stores, thread_scores[0]);
+
     auto range = std::vector<int>(n_threads, 0);
     std::iota(std::begin(range), std::end(range), 0);
     auto batch = std::vector<std::vector<MatchInfo>>(n_threads);
@@ -185,18 +670,20 @@ auto multi_threaded_search(const qdata::SearchArgs& search_args) -> std::vector<
         sj.reserve(search_args.batch_size);
     }
 
-    for (const auto& filename : search_args.filenames) {
+    for (const auto& filename : streamed_files) {
+        if (_is_cancelled(search_args)) {
+            break;
+        }
         // TODO: this is a duplicate of `start_search`.
         bool using_cin = filename.empty();
-        std::ifstream fis = std::ifstream(filename);
-        auto& is = using_cin ? std::cin : fis;
-        // This makes reading from stdin fast.
-        if (using_cin) {
-            std::ios::sync_with_stdio(false);
+        int fd = using_cin ? STDIN_FILENO : open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            continue;
         }
 
-        for (int n_lines_read = 1; n_lines_read > -1;) {
-            n_lines_read = _fill_batch(batch, is, search_args.batch_size, n_lines_read, filename);
+        auto reader = linestore::BlockReader(fd);
+        for (int n_lines_read = 1; (n_lines_read > -1) && !_is_cancelled(search_args);) {
+            n_lines_read = _fill_batch(batch, reader, search_args.batch_size, n_lines_read, filename);
             std::for_each(
                     std::execution::par,
                     std::cbegin(range), std::cend(range),
@@ -204,28 +691,28 @@ auto multi_threaded_search(const qdata::SearchArgs& search_args) -> std::vector<
                         _search<Scorer>(search_args, thread_scores[k], batch[k]);
                     });
         }
-        fis.close();
-    }
-
-    // Aggregate thread-specific scores into a single vector, sort, and show.
-    auto best_scores = std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>>();
-    best_scores.reserve(search_args.topk * n_threads);
-    for (const auto& scores : thread_scores) {
-        for (const auto& score : scores) {
-            best_scores.push_back(score);
+        if (!using_cin) {
+            close(fd);
         }
     }
-    std::sort(
-            std::execution::par,
-            std::begin(best_scores), std::end(best_scores),
-            _comparator);
-    return best_scores;
+
+    return _merge_scores(thread_scores);
 }
 
+/**
+ * Search a vector using all threads.
+ *
+ * The strings are searched in batches split among all threads.
+ * Progress is reported between batches.
+ *
+ * @param on_progress called every `progress_interval` with the best
+ *      matches so far, if not empty.
+*/
 template<typename Scorer>
-auto multi_threaded_search(const qdata::SearchArgs& search_args, const std::vector<std::string>& strings) -> std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>> {
+auto multi_threaded_search(const qdata::SearchArgs& search_args, const std::vector<std::string>& strings, const ProgressCallback& on_progress = nullptr, std::chrono::milliseconds progress_interval = default_progress_interval) -> std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>> {
     unsigned int n_threads = std::thread::hardware_concurrency();
     auto thread_scores = _create_scores(n_threads, search_args.topk);
+    auto progress = _Progress(on_progress, progress_interval);
 
     auto range = std::vector<int>(n_threads, 0);
     std::iota(std::begin(range), std::end(range), 0);
@@ -235,7 +722,7 @@ auto multi_threaded_search(const qdata::SearchArgs& search_args, const std::vect
     }
 
     const auto n_strings = std::size(strings);
-    for (int n_strings_read = 1; n_strings_read <= n_strings;) {
+    for (int n_strings_read = 0; (n_strings_read < n_strings) && !_is_cancelled(search_args);) {
         n_strings_read = _fill_batch(batch, strings, search_args.batch_size, n_strings_read);
         std::for_each(
                 std::execution::par,
@@ -243,21 +730,69 @@ auto multi_threaded_search(const qdata::SearchArgs& search_args, const std::vect
                 [&](const auto k) {
                     _search<Scorer>(search_args, thread_scores[k], batch[k]);
                 });
+        if (progress.is_due() && !_is_cancelled(search_args)) {
+            progress.report(_merge_scores(thread_scores));
+        }
     }
 
-    // Aggregate thread-specific scores into a single vector, sort, and show.
-    auto best_scores = std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>>();
-    best_scores.reserve(search_args.topk * n_threads);
-    for (const auto& scores : thread_scores) {
-        for (const auto& score : scores) {
-            best_scores.push_back(score);
-        }
+    return _merge_scores(thread_scores);
+}
+
+/**
+ * Search the lines of already loaded stores (see `filecache::FileCache`),
+ * or of compressed ones (see `fmindex::load_file`).
+*/
+template<typename Scorer, typename Store>
+auto search(const qdata::SearchArgs& search_args, const std::vector<std::shared_ptr<const Store>>& stores) -> std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>> {
+    if (search_args.parallel) {
+        return multi_threaded_search<Scorer>(search_args, stores);
+    }
+    return single_threaded_search<Scorer>(search_args, stores);
+}
+
+/**
+ * Search the lines of already loaded stores, reporting progress.
+ *
+ * While the search runs, `on_progress` is called about every
+ * `interval` with a snapshot of the best matches found so far, merged
+ * from the heaps of all threads.  It isn't called for the final
+ * results, which are returned as usual, nor after the search is
+ * cancelled.  It may be called from any of the searching threads (but
+ * never concurrently), so it should be quick.
+*/
+template<typename Scorer, typename Store>
+auto search(const qdata::SearchArgs& search_args, const std::vector<std::shared_ptr<const Store>>& stores, const ProgressCallback& on_progress, std::chrono::milliseconds interval = default_progress_interval) -> std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>> {
+    if (search_args.parallel) {
+        return multi_threaded_search<Scorer>(search_args, stores, on_progress, interval);
+    }
+    return single_threaded_search<Scorer>(search_args, stores, on_progress, interval);
+}
+
+/**
+ * Search the given lines of already loaded stores, reporting progress
+ * (see the overload without candidates).
+ *
+ * @param candidates for each store, the ids of the lines to search in
+ *      increasing order (eg. the lines shown of a store), or nothing
+ *      to search all of them.  The indexes are not used.
+*/
+template<typename Scorer, typename Store>
+auto search(const qdata::SearchArgs& search_args, const std::vector<std::shared_ptr<const Store>>& stores, const std::vector<std::optional<std::vector<std::uint32_t>>>& candidates, const ProgressCallback& on_progress = nullptr, std::chrono::milliseconds interval = default_progress_interval) -> std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>> {
+    if (search_args.parallel) {
+        return multi_threaded_search<Scorer>(search_args, stores, candidates, on_progress, interval);
+    }
+    return single_threaded_search<Scorer>(search_args, stores, candidates, on_progress, interval);
+}
+
+/**
+ * Search a vector, reporting progress (see the overload for stores).
+*/
+template<typename Scorer>
+auto search(const qdata::SearchArgs& search_args, const std::vector<std::string>& strings, const ProgressCallback& on_progress, std::chrono::milliseconds interval = default_progress_interval) -> std::vector<std::pair<fuzzy::ScoreResults, MatchInfo>> {
+    if (search_args.parallel) {
+        return multi_threaded_search<Scorer>(search_args, strings, on_progress, interval);
     }
-    std::sort(
-            std::execution::par,
-            std::begin(best_scores), std::end(best_scores),
-            _comparator);
-    return best_scores;
+    return single_threaded_search<Scorer>(search_args, strings, on_progress, interval);
 }
 
 template<typename Scorer>
@@ -0,0 +1,82 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "linestore.h"
+#include "pairindex.h"
+#include "scheduler.h"
+
+namespace {
+
+/**
+ * Number of blocks summarized by a worker at a time.
+*/
+constexpr std::size_t build_unit_size = 1 << 6;
+
+/**
+ * The class of each byte: letters (case folded) and digits have their
+ * own, and other bytes share the 28 left.
+*/
+constexpr auto class_table = []() {
+    auto table = std::array<std::uint8_t, 256>();
+    for (int c = 0; c < 256; ++c) {
+        if ((c >= 'a') && (c <= 'z')) {
+            table[c] = c - 'a';
+        }
+        else if ((c >= 'A') && (c <= 'Z')) {
+            table[c] = c - 'A';
+        }
+        else if ((c >= '0') && (c <= '9')) {
+            table[c] = 26 + (c - '0');
+        }
+        else {
+            table[c] = 36 + (c % 28);
+        }
+    }
+    return table;
+}();
+
+} // namespace
+
+auto pairindex::Summary::add(std::string_view s) -> void {
+    std::uint64_t seen = 0;
+    for (const auto c : s) {
+        const auto k = class_table[static_cast<unsigned char>(c)];
+        pairs[k] |= seen;
+        seen |= std::uint64_t(1) << k;
+    }
+    chars |= seen;
+}
+
+auto pairindex::Summary::contains(const Summary& other) const -> bool {
+    auto missing = other.chars & ~chars;
+    for (std::size_t k = 0; k < n_classes; ++k) {
+        missing |= other.pairs[k] & ~pairs[k];
+    }
+    return missing == 0;
+}
+
+auto pairindex::build(const linestore::LineStore& lines, unsigned int n_threads, const std::atomic<bool>* cancel) -> Index {
+    const auto is_cancelled = [&]() { return (cancel != nullptr) && cancel->load(std::memory_order_relaxed); };
+    auto index = Index();
+    index.n_lines = lines.size();
+    index.blocks.resize((lines.size() + block_size - 1) / block_size);
+
+    const auto units = scheduler::make_units({index.blocks.size()}, build_unit_size);
+    scheduler::run(units.size(), std::max(n_threads, 1u), [&](const auto worker, const auto j) {
+            if (is_cancelled()) {
+                return;
+            }
+            for (auto k = units[j].beg; k < units[j].end; ++k) {
+                auto& block = index.blocks[k];
+                const auto end = std::min(lines.size(), (k + 1) * block_size);
+                for (auto line = k * block_size; line < end; ++line) {
+                    block.add(lines.line(line));
+                }
+            }
+            });
+    return is_cancelled() ? Index() : std::move(index);
+}
@@ -165,26 +165,32 @@ auto qparse::select_parse(std::string::const_iterator& beg, std::string::const_i
     const auto& ch = *beg;
     auto s = std::string();
     std::unique_ptr<filtertree::Filter> qp;
+    // Filters search for their own term, not the whole query.
+    const auto term_data = [&](const std::string& term) {
+        qdata::SearchArgs sa = search_args;
+        sa.q = term;
+        return qdata::QueryData(sa);
+    };
 
     if (ch == '^') {
         ++beg;
         s = qparse::parse_prefix(beg, end);
-        qp = std::make_unique<filtertree::Filter>(std::move(qdata::QueryData(search_args)), false, filters::find_prefix, filtertree::FilterType::VARIABLE);
+        qp = std::make_unique<filtertree::Filter>(term_data(s), false, filters::find_prefix, filtertree::FilterType::VARIABLE);
     }
     else if (ch == '$') {
         ++beg;
         s = qparse::parse_suffix(beg, end);
-        qp = std::make_unique<filtertree::Filter>(std::move(qdata::QueryData(search_args)), false, filters::find_suffix, filtertree::FilterType::VARIABLE);
+        qp = std::make_unique<filtertree::Filter>(term_data(s), false, filters::find_suffix, filtertree::FilterType::VARIABLE);
     }
     else if (ch == '"') {
         ++beg;
         s = qparse::parse_phrase(beg, end);
-        qp = std::make_unique<filtertree::Filter>(std::move(qdata::QueryData(search_args)), false, filters::find_subseq, filtertree::FilterType::VARIABLE);
+        qp = std::make_unique<filtertree::Filter>(term_data(s), false, filters::find_subseq, filtertree::FilterType::VARIABLE);
     }
     else if (ch == '=') {
         ++beg;
         s = qparse::parse_exact(beg, end, exact_delims);
-        qp = std::make_unique<filtertree::Filter>(std::move(qdata::QueryData(search_args)), false, filters::find, filtertree::FilterType::VARIABLE);
+        qp = std::make_unique<filtertree::Filter>(term_data(s), false, filters::find, filtertree::FilterType::VARIABLE);
     }
     else if ((ch == '!') && !ignore_neg) {
         ++beg;
@@ -194,7 +200,7 @@ auto qparse::select_parse(std::string::const_iterator& beg, std::string::const_i
     else if (ch == '~') {
         ++beg;
         s = qparse::parse_fuzzy(beg, end);
-        qp = std::make_unique<filtertree::Filter>(std::move(qdata::QueryData(search_args)), false, filters::find_subseq, filtertree::FilterType::VARIABLE);
+        qp = std::make_unique<filtertree::Filter>(term_data(s), false, filters::find_subseq, filtertree::FilterType::VARIABLE);
     }
     else if (ch == '(') {
         ++beg;
@@ -215,7 +221,7 @@ auto qparse::select_parse(std::string::const_iterator& beg, std::string::const_i
     }
     else {
         s = qparse::parse_default(beg, end);
-        qp = std::make_unique<filtertree::Filter>(std::move(qdata::QueryData(search_args)), false, filters::find_subseq, filtertree::FilterType::VARIABLE);
+        qp = std::make_unique<filtertree::Filter>(term_data(s), false, filters::find_subseq, filtertree::FilterType::VARIABLE);
     }
     return qp;
 }
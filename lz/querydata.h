@@ -1,14 +1,27 @@
 #ifndef SUBSEQSEARCH_QUERYDATA_H
 #define SUBSEQSEARCH_QUERYDATA_H
 
+#include <atomic>
 #include <vector>
 #include <string>
 
+namespace lineindex {
+class Indexer;
+} // namespace lineindex
+
 namespace qrydata {
 
 /**
  * Arguments, mainly from the command line, for how to search.
  * These are shared among all threads.
+ *
+ * A search stops early once `*cancel` is set, for when its results
+ * are no longer needed (eg. the query changed).  It is checked every
+ * thousand or so lines, and the results of a cancelled search are
+ * incomplete.
+ *
+ * Searches of stores only go through the lines that the indexes of
+ * `*indexer` (if any) leave (see `lineindex::find_candidates`).
 */
 struct SearchArgs {
     std::string q;
@@ -23,6 +36,8 @@ struct SearchArgs {
     std::string gap_penalty;
     std::string word_delims;
     bool show_color;
+    const std::atomic<bool>* cancel = nullptr;
+    const lineindex::Indexer* indexer = nullptr;
 };
 
 /**
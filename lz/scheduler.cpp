@@ -0,0 +1,19 @@
+#include <algorithm>
+#include <vector>
+
+#include "scheduler.h"
+
+auto scheduler::make_units(const std::vector<std::size_t>& sizes, std::size_t max_unit_size) -> std::vector<WorkUnit> {
+    max_unit_size = std::max(max_unit_size, std::size_t(1));
+    auto units = std::vector<WorkUnit>();
+    units.reserve(sizes.size());
+    for (std::size_t source = 0; source < sizes.size(); ++source) {
+        for (std::size_t beg = 0; beg < sizes[source]; beg += max_unit_size) {
+            units.push_back(WorkUnit{
+                    .source=source,
+                    .beg=beg,
+                    .end=std::min(sizes[source], beg + max_unit_size)});
+        }
+    }
+    return units;
+}
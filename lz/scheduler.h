@@ -0,0 +1,65 @@
+#ifndef SUBSEQSEARCH_SCHEDULER_H
+#define SUBSEQSEARCH_SCHEDULER_H
+
+#include <algorithm>
+#include <atomic>
+#include <execution>
+#include <numeric>
+#include <vector>
+
+namespace scheduler {
+
+/**
+ * A unit of work: the items `[beg, end)` of the `source`th input.
+ *
+ * What an item is depends on the caller (usually a line).
+*/
+struct WorkUnit {
+    std::size_t source;
+    std::size_t beg;
+    std::size_t end;
+};
+
+/**
+ * Split inputs into units of work.
+ *
+ * An input with at most `max_unit_size` items is a single unit, so
+ * many small inputs are spread across workers whole.  Larger inputs
+ * are split into chunks of `max_unit_size` items.  Units are ordered
+ * by input and then by position in the input.
+ *
+ * @param sizes number of items of each input.
+ * @param max_unit_size maximum number of items in a unit.
+*/
+auto make_units(const std::vector<std::size_t>& sizes, std::size_t max_unit_size) -> std::vector<WorkUnit>;
+
+/**
+ * Run `f(worker, unit_idx)` for every unit.
+ *
+ * Workers pull the next unit from a shared counter, so a worker that
+ * finishes early takes more units instead of waiting on the others.
+ * No two workers ever run with the same `worker` index at the same
+ * time, so `worker` can be used to index per-worker state.
+ *
+ * @param n_units number of units.
+ * @param n_workers number of workers.
+ * @param f function of a worker index and a unit index.
+*/
+template<typename F>
+auto run(std::size_t n_units, unsigned int n_workers, F f) -> void {
+    auto next_unit = std::atomic<std::size_t>(0);
+    auto workers = std::vector<unsigned int>(n_workers, 0);
+    std::iota(std::begin(workers), std::end(workers), 0);
+    std::for_each(
+            std::execution::par,
+            std::cbegin(workers), std::cend(workers),
+            [&](const auto worker) {
+                for (auto j = next_unit++; j < n_units; j = next_unit++) {
+                    f(worker, j);
+                }
+            });
+}
+
+} // namespace scheduler
+
+#endif
@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "filecache.h"
+#include "linestore.h"
+#include "snapshot.h"
+
+namespace {
+
+constexpr std::array<char, 8> magic = {'M', 'E', 'W', 'S', 'N', 'A', 'P', '\0'};
+
+/**
+ * Written as is, so that snapshots from a machine with another byte
+ * order don't match.
+*/
+constexpr std::uint32_t byte_order_mark = 0x01020304;
+
+/**
+ * Start of a snapshot.
+*/
+struct Header {
+    std::array<char, 8> magic;
+    std::uint32_t version;
+    std::uint32_t byte_order_mark;
+    std::uint64_t n_entries;
+};
+
+/**
+ * Start of an entry.  It is followed by the name, the arena and the
+ * offsets of its store, each padded to a multiple of 8 bytes.
+*/
+struct EntryHeader {
+    std::int64_t size;
+    std::int64_t mtime;
+    std::uint64_t name_size;
+    std::uint64_t n_bytes;
+    std::uint64_t n_offsets;
+};
+
+/**
+ * @return `n` rounded up to a multiple of 8.
+*/
+auto pad(std::size_t n) -> std::size_t {
+    return (n + 7) & ~std::size_t(7);
+}
+
+/**
+ * Write `data[0, n)` followed by zeros up to a multiple of 8 bytes.
+ *
+ * @return false on error.
+*/
+auto write_padded(int fd, const void* data, std::size_t n) -> bool {
+    const auto* bytes = static_cast<const char*>(data);
+    for (std::size_t n_written = 0; n_written < n;) {
+        auto n_cur = write(fd, bytes + n_written, n - n_written);
+        if (n_cur <= 0) {
+            return false;
+        }
+        n_written += n_cur;
+    }
+    const char zeros[8] = {};
+    return (pad(n) == n) || (write(fd, zeros, pad(n) - n) == long(pad(n) - n));
+}
+
+/**
+ * Reads the sections of a mapped snapshot in order, checking that
+ * they are inside it.
+*/
+struct Cursor {
+    const char* data;
+    std::size_t size;
+    std::size_t pos;
+
+    /**
+     * Take the next `n` bytes, and the padding after them.
+     *
+     * @return the bytes, or nullptr if the snapshot is too short.
+    */
+    auto take(std::size_t n) -> const char* {
+        if ((n > size) || (pos > size - n)) {
+            return nullptr;
+        }
+        const auto* cur = data + pos;
+        pos = std::min(size, pos + pad(n));
+        return cur;
+    }
+};
+
+/**
+ * Tell whether `offsets` split `text` into lines that a store can
+ * view without reading past `text`: they start at 0, increase, end at
+ * the end of `text`, and `text` ends with a null byte, so that reading
+ * a line as a C string stops inside it (see
+ * `linestore::LineStore::c_str`).
+ *
+ * Only the offsets and the last byte of `text` are read, so the pages
+ * of the text aren't touched until lines are used.  A line missing its
+ * null byte in a corrupt snapshot would run into the next line, but
+ * not past the text.
+*/
+auto are_valid_offsets(std::string_view text, std::span<const std::uint64_t> offsets) -> bool {
+    if ((offsets.front() != 0) || (offsets.back() != text.size())) {
+        return false;
+    }
+    if (!text.empty() && (text.back() != '\0')) {
+        return false;
+    }
+    return std::ranges::adjacent_find(offsets, std::ranges::greater_equal()) == std::end(offsets);
+}
+
+} // namespace
+
+auto snapshot::save(const std::string& filename, const std::vector<filecache::Entry>& entries) -> bool {
+    const auto tmp_filename = filename + ".tmp" + std::to_string(getpid());
+    int fd = open(tmp_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    auto header = Header{.magic=magic, .version=version, .byte_order_mark=byte_order_mark, .n_entries=entries.size()};
+    bool ok = write_padded(fd, &header, sizeof(header));
+    for (const auto& entry : entries) {
+        if (!ok) {
+            break;
+        }
+        const auto& lines = *entry.lines;
+        const auto text = lines.get_text();
+        const auto offsets = lines.get_offsets();
+        auto entry_header = EntryHeader{
+            .size=entry.size,
+            .mtime=entry.mtime,
+            .name_size=lines.get_name().size(),
+            .n_bytes=text.size(),
+            .n_offsets=offsets.size(),
+        };
+        ok = write_padded(fd, &entry_header, sizeof(entry_header))
+            && write_padded(fd, lines.get_name().data(), lines.get_name().size())
+            && write_padded(fd, text.data(), text.size())
+            && write_padded(fd, offsets.data(), offsets.size_bytes());
+    }
+
+    ok = (close(fd) == 0) && ok;
+    if (!ok || (rename(tmp_filename.c_str(), filename.c_str()) != 0)) {
+        unlink(tmp_filename.c_str());
+        return false;
+    }
+    return true;
+}
+
+auto snapshot::load(const std::string& filename) -> std::optional<std::vector<filecache::Entry>> {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || (st.st_size < long(sizeof(Header)))) {
+        close(fd);
+        return std::nullopt;
+    }
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return std::nullopt;
+    }
+    const std::size_t size = st.st_size;
+    auto mapping = std::shared_ptr<const void>(addr, [size](const void* p) { munmap(const_cast<void*>(p), size); });
+
+    auto cursor = Cursor{.data=static_cast<const char*>(addr), .size=size, .pos=0};
+    auto header = Header();
+    std::memcpy(&header, cursor.take(sizeof(header)), sizeof(header));
+    if ((header.magic != magic) || (header.version != version) || (header.byte_order_mark != byte_order_mark)) {
+        return std::nullopt;
+    }
+
+    auto entries = std::vector<filecache::Entry>();
+    for (std::uint64_t j = 0; j < header.n_entries; ++j) {
+        const auto* entry_data = cursor.take(sizeof(EntryHeader));
+        if (entry_data == nullptr) {
+            return std::nullopt;
+        }
+        auto entry_header = EntryHeader();
+        std::memcpy(&entry_header, entry_data, sizeof(entry_header));
+
+        const auto* name = cursor.take(entry_header.name_size);
+        const auto* text = cursor.take(entry_header.n_bytes);
+        const auto n_offsets = entry_header.n_offsets;
+        const auto* offsets_data = (n_offsets <= (size / sizeof(std::uint64_t))) ? cursor.take(n_offsets * sizeof(std::uint64_t)) : nullptr;
+        if ((name == nullptr) || (text == nullptr) || (offsets_data == nullptr) || (n_offsets == 0)) {
+            return std::nullopt;
+        }
+        // Sections start at multiples of 8 bytes, and so does the
+        // mapping, so the offsets can be used in place.
+        const auto offsets = std::span<const std::uint64_t>(reinterpret_cast<const std::uint64_t*>(offsets_data), n_offsets);
+        const auto text_view = std::string_view(text, entry_header.n_bytes);
+        if (!are_valid_offsets(text_view, offsets)) {
+            return std::nullopt;
+        }
+
+        auto lines = std::make_shared<linestore::LineStore>(std::string(name, entry_header.name_size));
+        linestore::load_mapped(mapping, text_view, offsets, *lines);
+        entries.push_back(filecache::Entry{.size=entry_header.size, .mtime=entry_header.mtime, .lines=std::move(lines)});
+    }
+    return entries;
+}
@@ -0,0 +1,56 @@
+#ifndef SUBSEQSEARCH_SNAPSHOT_H
+#define SUBSEQSEARCH_SNAPSHOT_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "filecache.h"
+
+namespace snapshot {
+
+/**
+ * Version of the snapshot format.  Snapshots written with another
+ * version (or on a machine with another byte order) are not loaded.
+*/
+constexpr std::uint32_t version = 1;
+
+/**
+ * Write the lines of several sources to a snapshot.
+ *
+ * The snapshot holds, for each entry, the name of its store, its
+ * cache key (see `filecache::Entry`), its arena and its offsets, each
+ * starting at a multiple of 8 bytes so that they can be used in place
+ * once mapped (see `load`).  It holds the lines only: indexes built
+ * over them (see `lineindex::Indexer`) and compressed stores (see
+ * `fmindex::Index`) are not saved, and are built again from the
+ * mapped stores by each process that needs them.
+ *
+ * The snapshot is written to a temporary file that is then renamed to
+ * `filename`, so processes that mapped the previous snapshot keep
+ * their copy, and no process sees a partly written one.
+ *
+ * @return false if the snapshot could not be written.
+*/
+auto save(const std::string& filename, const std::vector<filecache::Entry>& entries) -> bool;
+
+/**
+ * Map a snapshot written by `save`.
+ *
+ * The snapshot is mapped read-only and shared, so processes that map
+ * the same snapshot share its pages.  The stores view the mapping (see
+ * `linestore::load_mapped`), which stays mapped as long as any of
+ * them does.  The offsets of each store and the end of its arena are
+ * checked before it is used, so that a corrupt snapshot can't make a
+ * store read past its arena, but the text is not read until lines are
+ * used.
+ *
+ * @return the entries in the order they were saved, or nothing if the
+ *      snapshot doesn't exist, has another version, or is invalid.
+*/
+auto load(const std::string& filename) -> std::optional<std::vector<filecache::Entry>>;
+
+} // namespace snapshot
+
+#endif
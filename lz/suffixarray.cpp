@@ -0,0 +1,270 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "linestore.h"
+#include "scheduler.h"
+#include "suffixarray.h"
+
+namespace {
+
+/**
+ * Chunks of the arena are about this many bytes.  SA-IS needs about 9
+ * bytes per byte of a chunk while sorting it, on top of its suffix
+ * array.
+*/
+constexpr std::size_t chunk_size = std::size_t(1) << 25;
+
+/**
+ * Marks the positions of a suffix array that aren't filled yet.
+*/
+constexpr std::uint32_t no_suffix = ~std::uint32_t(0);
+
+/**
+ * ASCII case folding of each byte.
+*/
+constexpr auto fold_table = []() {
+    auto table = std::array<std::uint8_t, 256>();
+    for (int c = 0; c < 256; ++c) {
+        table[c] = ((c >= 'A') && (c <= 'Z')) ? (c - 'A' + 'a') : c;
+    }
+    return table;
+}();
+
+auto fold(char c) -> std::uint8_t {
+    return fold_table[static_cast<unsigned char>(c)];
+}
+
+/**
+ * Sort the suffixes of `s` with SA-IS (see `suffixarray::sort_suffixes`).
+ *
+ * Suffixes are split into S (smaller than the next suffix) and L
+ * (larger) suffixes.  The leftmost S suffixes of each run (LMS) are
+ * sorted by their substrings up to the next LMS suffix by induced
+ * sorting, named by rank, and sorted for good by sorting the suffixes
+ * of the string of names, recursively.  The other suffixes are then
+ * induced from them.
+ *
+ * @param s the string, whose characters are at most `upper`.
+ *
+ * @return the positions of the suffixes of `s`, in increasing order
+ *      of the suffixes.
+*/
+template<typename T>
+auto sa_is(std::span<const T> s, std::uint32_t upper) -> std::vector<std::uint32_t> {
+    const std::uint32_t n = s.size();
+    if (n == 0) {
+        return {};
+    }
+    if (n == 1) {
+        return {0};
+    }
+    if (n == 2) {
+        return (s[0] < s[1]) ? std::vector<std::uint32_t>{0, 1} : std::vector<std::uint32_t>{1, 0};
+    }
+
+    auto is_s = std::vector<bool>(n);
+    for (std::uint32_t i = n - 1; i-- > 0;) {
+        is_s[i] = (s[i] == s[i + 1]) ? is_s[i + 1] : (s[i] < s[i + 1]);
+    }
+
+    // Where the S and L suffixes of each character start in the
+    // suffix array.  L suffixes of a character come before its S
+    // suffixes.
+    auto s_starts = std::vector<std::uint32_t>(upper + 1);
+    auto l_starts = std::vector<std::uint32_t>(upper + 1);
+    for (std::uint32_t i = 0; i < n; ++i) {
+        if (!is_s[i]) {
+            ++s_starts[s[i]];
+        }
+        else {
+            ++l_starts[s[i] + 1];
+        }
+    }
+    for (std::uint32_t c = 0; c <= upper; ++c) {
+        s_starts[c] += l_starts[c];
+        if (c < upper) {
+            l_starts[c + 1] += s_starts[c];
+        }
+    }
+
+    auto sa = std::vector<std::uint32_t>(n);
+    const auto induce = [&](const std::vector<std::uint32_t>& lms) {
+        std::ranges::fill(sa, no_suffix);
+        auto next = s_starts;
+        for (const auto j : lms) {
+            sa[next[s[j]]++] = j;
+        }
+        next = l_starts;
+        sa[next[s[n - 1]]++] = n - 1;
+        for (std::uint32_t i = 0; i < n; ++i) {
+            const auto j = sa[i];
+            if ((j != no_suffix) && (j >= 1) && !is_s[j - 1]) {
+                sa[next[s[j - 1]]++] = j - 1;
+            }
+        }
+        next = l_starts;
+        for (std::uint32_t i = n; i-- > 0;) {
+            const auto j = sa[i];
+            if ((j != no_suffix) && (j >= 1) && is_s[j - 1]) {
+                sa[--next[s[j - 1] + 1]] = j - 1;
+            }
+        }
+    };
+
+    auto lms_ids = std::vector<std::uint32_t>(n, no_suffix);
+    auto lms = std::vector<std::uint32_t>();
+    for (std::uint32_t i = 1; i < n; ++i) {
+        if (!is_s[i - 1] && is_s[i]) {
+            lms_ids[i] = lms.size();
+            lms.push_back(i);
+        }
+    }
+    const std::uint32_t m = lms.size();
+    induce(lms);
+    if (m == 0) {
+        return sa;
+    }
+
+    // Name the LMS substrings in sorted order, with equal substrings
+    // named alike.
+    auto sorted_lms = std::vector<std::uint32_t>();
+    sorted_lms.reserve(m);
+    for (const auto j : sa) {
+        if (lms_ids[j] != no_suffix) {
+            sorted_lms.push_back(j);
+        }
+    }
+    auto names = std::vector<std::uint32_t>(m);
+    std::uint32_t name = 0;
+    names[lms_ids[sorted_lms[0]]] = 0;
+    for (std::uint32_t i = 1; i < m; ++i) {
+        auto l = sorted_lms[i - 1];
+        auto r = sorted_lms[i];
+        const auto end_l = (lms_ids[l] + 1 < m) ? lms[lms_ids[l] + 1] : n;
+        const auto end_r = (lms_ids[r] + 1 < m) ? lms[lms_ids[r] + 1] : n;
+        bool same = (end_l - l == end_r - r);
+        if (same) {
+            for (; (l < end_l) && (s[l] == s[r]); ++l, ++r) {}
+            same = (l != n) && (s[l] == s[r]);
+        }
+        if (!same) {
+            ++name;
+        }
+        names[lms_ids[sorted_lms[i]]] = name;
+    }
+
+    const auto names_sa = sa_is(std::span<const std::uint32_t>(names), name);
+    for (std::uint32_t i = 0; i < m; ++i) {
+        sorted_lms[i] = lms[names_sa[i]];
+    }
+    induce(sorted_lms);
+    return sa;
+}
+
+} // namespace
+
+auto suffixarray::sort_suffixes(std::span<const std::uint8_t> text) -> std::vector<std::uint32_t> {
+    return sa_is(text, 255);
+}
+
+auto suffixarray::Index::get_key(std::string_view literal, bool at_line_end) -> std::string {
+    auto key = std::string(literal);
+    std::ranges::transform(key, std::begin(key), [](const auto c) { return char(fold(c)); });
+    if (at_line_end) {
+        key.push_back('\0');
+    }
+    return key;
+}
+
+auto suffixarray::Index::equal_range(std::string_view text, const Chunk& chunk, std::string_view key) -> std::pair<std::size_t, std::size_t> {
+    // Compare the start of a suffix to the key, as unsigned bytes.
+    const auto compare = [&](const std::uint32_t suffix) {
+        const auto pos = chunk.beg + suffix;
+        const auto n = std::min(key.size(), chunk.end - pos);
+        for (std::size_t j = 0; j < n; ++j) {
+            const auto a = fold(text[pos + j]);
+            const auto b = static_cast<unsigned char>(key[j]);
+            if (a != b) {
+                return (a < b) ? -1 : 1;
+            }
+        }
+        return (n < key.size()) ? -1 : 0;
+    };
+    const auto beg = std::ranges::partition_point(chunk.suffixes, [&](const auto suffix) { return compare(suffix) < 0; });
+    const auto end = std::ranges::partition_point(beg, std::cend(chunk.suffixes), [&](const auto suffix) { return compare(suffix) == 0; });
+    return {beg - std::cbegin(chunk.suffixes), end - std::cbegin(chunk.suffixes)};
+}
+
+auto suffixarray::Index::count(const linestore::LineStore& lines, std::string_view literal, bool at_line_end) const -> std::size_t {
+    const auto key = get_key(literal, at_line_end);
+    std::size_t n = 0;
+    for (const auto& chunk : chunks) {
+        const auto [beg, end] = equal_range(lines.get_text(), chunk, key);
+        n += end - beg;
+    }
+    return n;
+}
+
+auto suffixarray::Index::find(const linestore::LineStore& lines, std::string_view literal, bool at_line_start, bool at_line_end) const -> std::optional<std::vector<std::uint32_t>> {
+    if (literal.empty()) {
+        return std::nullopt;
+    }
+    const auto key = get_key(literal, at_line_end);
+    const auto text = lines.get_text();
+    const auto offsets = lines.get_offsets();
+
+    // Occurrences are found in arena order, chunk by chunk, so their
+    // lines are found by going forward through the offsets.
+    auto result = std::vector<std::uint32_t>();
+    auto positions = std::vector<std::uint32_t>();
+    auto line = std::cbegin(offsets);
+    for (const auto& chunk : chunks) {
+        const auto [beg, end] = equal_range(text, chunk, key);
+        positions.assign(std::cbegin(chunk.suffixes) + beg, std::cbegin(chunk.suffixes) + end);
+        std::ranges::sort(positions);
+        for (const auto suffix : positions) {
+            const auto pos = chunk.beg + suffix;
+            if (at_line_start && (pos > 0) && (text[pos - 1] != '\0')) {
+                continue;
+            }
+            line = std::upper_bound(line, std::cend(offsets), pos) - 1;
+            const auto id = std::uint32_t(line - std::cbegin(offsets));
+            if (result.empty() || (result.back() != id)) {
+                result.push_back(id);
+            }
+        }
+    }
+    return result;
+}
+
+auto suffixarray::build(const linestore::LineStore& lines, unsigned int n_threads, const std::atomic<bool>* cancel) -> Index {
+    const auto is_cancelled = [&]() { return (cancel != nullptr) && cancel->load(std::memory_order_relaxed); };
+    const auto text = lines.get_text();
+    const auto offsets = lines.get_offsets();
+
+    auto index = Index();
+    index.n_lines = lines.size();
+    for (std::size_t k = 0; k < lines.size();) {
+        const auto beg = offsets[k];
+        for (++k; (k < lines.size()) && (offsets[k] - beg < chunk_size); ++k) {}
+        index.chunks.push_back(Index::Chunk{.beg=beg, .end=offsets[k], .suffixes={}});
+    }
+
+    scheduler::run(index.chunks.size(), std::max(n_threads, 1u), [&](const auto worker, const auto j) {
+            if (is_cancelled()) {
+                return;
+            }
+            auto& chunk = index.chunks[j];
+            auto folded = std::vector<std::uint8_t>(chunk.end - chunk.beg);
+            std::ranges::transform(text.substr(chunk.beg, chunk.end - chunk.beg), std::begin(folded), fold);
+            chunk.suffixes = sort_suffixes(folded);
+            });
+    return is_cancelled() ? Index() : std::move(index);
+}
@@ -0,0 +1,137 @@
+#ifndef SUBSEQSEARCH_SUFFIXARRAY_H
+#define SUBSEQSEARCH_SUFFIXARRAY_H
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "linestore.h"
+
+namespace suffixarray {
+
+/**
+ * Suffix arrays of the arena of a store.
+ *
+ * The arena is split into chunks of whole lines, and the suffixes of
+ * each chunk are sorted on their own, so chunks can be sorted in
+ * parallel and no chunk is too large for 32 bit positions.  No match
+ * spans two lines (lines end with a null byte), so none spans two
+ * chunks either.
+ *
+ * Suffixes are sorted case folded (ASCII), so lookups find a superset
+ * of the lines that match, whatever the case sensitivity of the query.
+ * The arena itself isn't copied: lookups compare against the lines of
+ * the store, which must be the one that was indexed.
+ *
+ *   chunks: the suffix array of each chunk.
+ *   n_lines: number of lines indexed.
+*/
+class Index {
+    friend auto build(const linestore::LineStore& lines, unsigned int n_threads, const std::atomic<bool>* cancel) -> Index;
+
+    public:
+        Index() : chunks(), n_lines(0) {}
+
+        /**
+         * Count the occurrences of `literal` in the lines, case
+         * folded.  Occurrences at the start of a line are counted
+         * whether or not `at_line_start` is set.
+         *
+         * @param lines the store that was indexed.
+         * @param at_line_end whether to count the occurrences that end
+         *      a line only.
+        */
+        auto count(const linestore::LineStore& lines, std::string_view literal, bool at_line_end = false) const -> std::size_t;
+
+        /**
+         * Find the lines that contain `literal`, case folded.
+         *
+         * @param lines the store that was indexed.
+         * @param at_line_start whether `literal` must start the line
+         *      (as with prefix filters).
+         * @param at_line_end whether `literal` must end the line (as
+         *      with suffix filters).
+         *
+         * @return ids of the lines in increasing order, or nothing if
+         *      `literal` is empty.
+        */
+        auto find(const linestore::LineStore& lines, std::string_view literal, bool at_line_start = false, bool at_line_end = false) const -> std::optional<std::vector<std::uint32_t>>;
+
+        /**
+         * @return number of lines indexed.
+        */
+        auto size() const -> std::size_t { return n_lines; }
+
+        /**
+         * @return number of bytes used by the suffix arrays.
+        */
+        auto n_bytes() const -> std::size_t {
+            std::size_t n = 0;
+            for (const auto& chunk : chunks) {
+                n += chunk.suffixes.size() * sizeof(chunk.suffixes[0]);
+            }
+            return n;
+        }
+
+    private:
+        /**
+         * The suffix array of a chunk of the arena.
+         *
+         *   beg: position in the arena where the chunk starts.
+         *   end: position in the arena where the chunk ends.
+         *   suffixes: positions in the chunk of its suffixes, in
+         *          increasing order of the suffixes.
+        */
+        struct Chunk {
+            std::size_t beg;
+            std::size_t end;
+            std::vector<std::uint32_t> suffixes;
+        };
+
+        /**
+         * Find the suffixes of a chunk that start with the case folded
+         * `key`.
+         *
+         * @return the range of `chunk.suffixes` that they are.
+        */
+        static auto equal_range(std::string_view text, const Chunk& chunk, std::string_view key) -> std::pair<std::size_t, std::size_t>;
+
+        /**
+         * @return `literal` case folded, followed by a null byte if it
+         *      ends the line.
+        */
+        static auto get_key(std::string_view literal, bool at_line_end) -> std::string;
+
+        std::vector<Chunk> chunks;
+        std::size_t n_lines;
+};
+
+/**
+ * Sort the suffixes of `text` with SA-IS (Nong, Zhang and Chan), in
+ * linear time.
+ *
+ * A suffix that is a prefix of another one comes first, as if `text`
+ * ended with a character smaller than all others.
+ *
+ * @return the positions of the suffixes of `text`, in increasing
+ *      order of the suffixes.
+*/
+auto sort_suffixes(std::span<const std::uint8_t> text) -> std::vector<std::uint32_t>;
+
+/**
+ * Build the suffix arrays of the arena of a store, with SA-IS.
+ *
+ * Chunks are sorted by `n_threads` threads at once.
+ *
+ * @param cancel if set while building, the build stops and the index
+ *      returned is empty.
+*/
+auto build(const linestore::LineStore& lines, unsigned int n_threads = 1, const std::atomic<bool>* cancel = nullptr) -> Index;
+
+} // namespace suffixarray
+
+#endif
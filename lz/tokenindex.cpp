@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "linestore.h"
+#include "scheduler.h"
+#include "tokenindex.h"
+#include "trigram.h"
+
+namespace {
+
+/**
+ * Number of lines that a thread indexes at once.
+*/
+constexpr std::size_t build_unit_size = 1 << 16;
+
+/**
+ * ASCII case folding of `c`.
+*/
+auto fold(char c) -> char {
+    return ((c >= 'A') && (c <= 'Z')) ? char(c - 'A' + 'a') : c;
+}
+
+/**
+ * The words of a chunk of lines, while building an index.
+ *
+ *   folded: case folded copies of the words that aren't in lower case
+ *          in the lines.
+ *   ids: id of each word in the chunk.
+ *   words: the word of each id.
+ *   last_line: one past the last line each word was seen in, or 0.
+ *   occurrences: `(id, line)` for each word of each line, in line
+ *          order.
+*/
+struct UnitWords {
+    std::deque<std::string> folded;
+    std::unordered_map<std::string_view, std::uint32_t> ids;
+    std::vector<std::string_view> words;
+    std::vector<std::uint32_t> last_line;
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> occurrences;
+};
+
+} // namespace
+
+auto tokenindex::Index::get_word(std::size_t j) const -> std::string_view {
+    return std::string_view(dictionary).substr(word_offsets[j], word_offsets[j + 1] - word_offsets[j]);
+}
+
+auto tokenindex::Index::get_postings(std::size_t j) const -> std::span<const std::uint32_t> {
+    return std::span<const std::uint32_t>(postings.data() + offsets[j], offsets[j + 1] - offsets[j]);
+}
+
+auto tokenindex::Index::find_piece(std::string_view piece, bool starts_word, bool ends_word) const -> std::vector<std::uint32_t> {
+    auto folded = std::string(piece);
+    std::ranges::transform(folded, std::begin(folded), fold);
+
+    // Words that start with the piece are a range of the dictionary.
+    // Other words are found by going through all of it.
+    auto word_ids = std::vector<std::size_t>();
+    if (starts_word) {
+        std::size_t lo = 0;
+        std::size_t hi = n_words();
+        while (lo < hi) {
+            const auto mid = lo + ((hi - lo) / 2);
+            if (get_word(mid) < folded) {
+                lo = mid + 1;
+            }
+            else {
+                hi = mid;
+            }
+        }
+        for (auto j = lo; (j < n_words()) && get_word(j).starts_with(folded); ++j) {
+            if (!ends_word || (get_word(j).size() == folded.size())) {
+                word_ids.push_back(j);
+            }
+        }
+    }
+    else {
+        for (std::size_t j = 0; j < n_words(); ++j) {
+            const auto word = get_word(j);
+            if (ends_word ? word.ends_with(folded) : (word.find(folded) != std::string_view::npos)) {
+                word_ids.push_back(j);
+            }
+        }
+    }
+
+    auto lines = std::vector<std::uint32_t>();
+    for (const auto j : word_ids) {
+        const auto word_lines = get_postings(j);
+        lines.insert(std::end(lines), std::cbegin(word_lines), std::cend(word_lines));
+    }
+    if (word_ids.size() > 1) {
+        std::ranges::sort(lines);
+        lines.erase(std::unique(std::begin(lines), std::end(lines)), std::end(lines));
+    }
+    return lines;
+}
+
+auto tokenindex::Index::find(std::string_view literal, bool at_line_start, bool at_line_end) const -> std::optional<std::vector<std::uint32_t>> {
+    auto pieces = std::vector<std::string_view>();
+    for (std::size_t beg = 0, j = 0; j <= literal.size(); ++j) {
+        if ((j == literal.size()) || (delims.find(literal[j]) != std::string::npos)) {
+            pieces.push_back(literal.substr(beg, j - beg));
+            beg = j + 1;
+        }
+    }
+
+    auto lines = std::optional<std::vector<std::uint32_t>>();
+    for (std::size_t j = 0; j < pieces.size(); ++j) {
+        if (pieces[j].empty()) {
+            continue;
+        }
+        const bool starts_word = (j > 0) || at_line_start;
+        const bool ends_word = (j + 1 < pieces.size()) || at_line_end;
+        auto piece_lines = find_piece(pieces[j], starts_word, ends_word);
+        lines = lines ? trigram::intersect(*lines, piece_lines) : std::move(piece_lines);
+        if (lines->empty()) {
+            break;
+        }
+    }
+    return lines;
+}
+
+auto tokenindex::build(const linestore::LineStore& lines, const std::string& delims, unsigned int n_threads, const std::atomic<bool>* cancel) -> Index {
+    const auto is_cancelled = [&]() { return (cancel != nullptr) && cancel->load(std::memory_order_relaxed); };
+    auto is_delim = std::array<bool, 256>();
+    for (const auto c : delims) {
+        is_delim[static_cast<unsigned char>(c)] = true;
+    }
+
+    // Each chunk of lines numbers its words on its own, and keeps the
+    // lines of each word (once per line) in line order.
+    const auto units = scheduler::make_units({lines.size()}, build_unit_size);
+    auto unit_words = std::vector<UnitWords>(units.size());
+    scheduler::run(units.size(), std::max(n_threads, 1u), [&](const auto worker, const auto j) {
+            if (is_cancelled()) {
+                return;
+            }
+            auto& unit = unit_words[j];
+            auto folded = std::string();
+            for (auto k = units[j].beg; k < units[j].end; ++k) {
+                const auto line = lines.line(k);
+                for (std::size_t i = 0; i < line.size();) {
+                    if (is_delim[static_cast<unsigned char>(line[i])]) {
+                        ++i;
+                        continue;
+                    }
+                    auto e = i;
+                    bool has_upper = false;
+                    for (; (e < line.size()) && !is_delim[static_cast<unsigned char>(line[e])]; ++e) {
+                        has_upper = has_upper || (fold(line[e]) != line[e]);
+                    }
+                    auto word = line.substr(i, e - i);
+                    i = e;
+
+                    if (has_upper) {
+                        folded = word;
+                        std::ranges::transform(folded, std::begin(folded), fold);
+                        word = folded;
+                    }
+                    auto it = unit.ids.find(word);
+                    if (it == std::end(unit.ids)) {
+                        // Words are views of the lines, or of a folded
+                        // copy kept by the chunk.
+                        if (has_upper) {
+                            word = unit.folded.emplace_back(folded);
+                        }
+                        it = unit.ids.emplace(word, unit.words.size()).first;
+                        unit.words.push_back(word);
+                        unit.last_line.push_back(0);
+                    }
+                    const auto id = it->second;
+                    if (unit.last_line[id] != k + 1) {
+                        unit.last_line[id] = k + 1;
+                        unit.occurrences.emplace_back(id, k);
+                    }
+                }
+            }
+            });
+    if (is_cancelled()) {
+        return Index();
+    }
+
+    // Sort the words of all chunks into the dictionary, and map the
+    // ids of each chunk to positions in it.
+    auto chunk_words = std::vector<std::tuple<std::string_view, std::uint32_t, std::uint32_t>>();
+    for (std::uint32_t j = 0; j < unit_words.size(); ++j) {
+        for (std::uint32_t id = 0; id < unit_words[j].words.size(); ++id) {
+            chunk_words.emplace_back(unit_words[j].words[id], j, id);
+        }
+    }
+    std::ranges::sort(chunk_words);
+
+    auto index = Index();
+    index.delims = delims;
+    index.n_lines = lines.size();
+    auto word_ids = std::vector<std::vector<std::uint32_t>>(units.size());
+    for (std::size_t j = 0; j < units.size(); ++j) {
+        word_ids[j].resize(unit_words[j].words.size());
+    }
+    for (const auto& [word, j, id] : chunk_words) {
+        if ((index.n_words() == 0) || (index.get_word(index.n_words() - 1) != word)) {
+            index.dictionary += word;
+            index.word_offsets.push_back(index.dictionary.size());
+        }
+        word_ids[j][id] = index.n_words() - 1;
+    }
+
+    // Posting lists are filled chunk by chunk, so they stay in line
+    // order.
+    auto counts = std::vector<std::uint64_t>(index.n_words());
+    for (std::size_t j = 0; j < units.size(); ++j) {
+        for (const auto& [id, line] : unit_words[j].occurrences) {
+            ++counts[word_ids[j][id]];
+        }
+    }
+    for (const auto count : counts) {
+        index.offsets.push_back(index.offsets.back() + count);
+    }
+    index.postings.resize(index.offsets.back());
+    auto& cursors = counts;
+    std::copy(std::cbegin(index.offsets), std::cend(index.offsets) - 1, std::begin(cursors));
+    for (std::size_t j = 0; j < units.size(); ++j) {
+        for (const auto& [id, line] : unit_words[j].occurrences) {
+            index.postings[cursors[word_ids[j][id]]++] = line;
+        }
+    }
+    return index;
+}
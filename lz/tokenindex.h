@@ -0,0 +1,129 @@
+#ifndef SUBSEQSEARCH_TOKENINDEX_H
+#define SUBSEQSEARCH_TOKENINDEX_H
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "linestore.h"
+
+namespace tokenindex {
+
+/**
+ * Posting lists of the words of the lines of a store.
+ *
+ * Lines are split into words by a set of delimiters (eg. the
+ * `word_delims` of searches), and words are case folded (ASCII), so
+ * lookups find a superset of the lines that match, whatever the case
+ * sensitivity of the query.
+ *
+ * Words are kept in a sorted dictionary, so the words with a given
+ * prefix are a range of it, and the dictionary is small enough next to
+ * the lines to be scanned for words with a given suffix or substring.
+ *
+ *   delims: the characters that split lines into words.
+ *   dictionary: the words, in increasing order, back to back.
+ *   word_offsets: the `j`th word is
+ *          `dictionary[word_offsets[j], word_offsets[j + 1])`.
+ *   offsets: the posting list of the `j`th word is
+ *          `postings[offsets[j], offsets[j + 1])`.
+ *   postings: line ids, increasing in each posting list.
+ *   n_lines: number of lines indexed.
+*/
+class Index {
+    friend auto build(const linestore::LineStore& lines, const std::string& delims, unsigned int n_threads, const std::atomic<bool>* cancel) -> Index;
+
+    public:
+        Index() : delims(), dictionary(), word_offsets{0}, offsets{0}, postings(), n_lines(0) {}
+
+        /**
+         * Find the lines that may contain `literal`.
+         *
+         * `literal` is split into pieces by the delimiters.  The
+         * pieces between two delimiters are whole words, the last one
+         * starts a word (looked up as a range of the dictionary), and
+         * the first one ends a word.  A literal without delimiters is
+         * in some word.  If the literal starts (ends) the line, its
+         * first (last) piece also starts (ends) a word.
+         *
+         * @param at_line_start whether `literal` starts the line (as
+         *      with prefix filters).
+         * @param at_line_end whether `literal` ends the line (as with
+         *      suffix filters).
+         *
+         * @return ids of the lines in increasing order, or nothing if
+         *      `literal` is only delimiters.
+        */
+        auto find(std::string_view literal, bool at_line_start = false, bool at_line_end = false) const -> std::optional<std::vector<std::uint32_t>>;
+
+        /**
+         * @return the characters that split lines into words.
+        */
+        auto get_delims() const -> const std::string& { return delims; }
+
+        /**
+         * @return number of lines indexed.
+        */
+        auto size() const -> std::size_t { return n_lines; }
+
+        /**
+         * @return number of distinct words.
+        */
+        auto n_words() const -> std::size_t { return word_offsets.size() - 1; }
+
+        /**
+         * @return number of bytes used by the dictionary and the
+         *      posting lists.
+        */
+        auto n_bytes() const -> std::size_t {
+            return dictionary.size() + (word_offsets.size() * sizeof(word_offsets[0])) + (offsets.size() * sizeof(offsets[0])) + (postings.size() * sizeof(postings[0]));
+        }
+
+    private:
+        /**
+         * @return the `j`th word of the dictionary.
+        */
+        auto get_word(std::size_t j) const -> std::string_view;
+
+        /**
+         * @return the posting list of the `j`th word.
+        */
+        auto get_postings(std::size_t j) const -> std::span<const std::uint32_t>;
+
+        /**
+         * Find the lines with a word that starts and/or ends with, or
+         * else contains, the case folded `piece`.
+         *
+         * @return ids of the lines in increasing order.
+        */
+        auto find_piece(std::string_view piece, bool starts_word, bool ends_word) const -> std::vector<std::uint32_t>;
+
+        std::string delims;
+        std::string dictionary;
+        std::vector<std::uint64_t> word_offsets;
+        std::vector<std::uint64_t> offsets;
+        std::vector<std::uint32_t> postings;
+        std::size_t n_lines;
+};
+
+/**
+ * Index the words of the lines of a store.
+ *
+ * Lines are split into chunks that `n_threads` threads index on their
+ * own.  The words of all chunks are then sorted into the dictionary,
+ * and their posting lists are concatenated in chunk order, so they
+ * stay in line order.
+ *
+ * @param delims characters that split lines into words.
+ * @param cancel if set while building, the build stops and the index
+ *      returned is empty.
+*/
+auto build(const linestore::LineStore& lines, const std::string& delims, unsigned int n_threads = 1, const std::atomic<bool>* cancel = nullptr) -> Index;
+
+} // namespace tokenindex
+
+#endif
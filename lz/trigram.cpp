@@ -0,0 +1,315 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "re2/filtered_re2.h"
+#include "re2/re2.h"
+
+#include "linestore.h"
+#include "scheduler.h"
+#include "trigram.h"
+
+namespace {
+
+/**
+ * Number of possible trigrams.
+*/
+constexpr std::size_t n_trigrams = std::size_t(1) << 24;
+
+/**
+ * @return the part of the trigrams, out of `n_parts`, that `key` is
+ *      in.  Trigrams that differ in their last byte only (which are
+ *      often as frequent) go to different parts.
+*/
+auto get_part(std::uint32_t key, unsigned int n_parts) -> unsigned int {
+    return (n_parts == 1) ? 0 : (((key * 0x9e3779b1u) >> 8) % n_parts);
+}
+
+/**
+ * ASCII case folding of each byte.
+*/
+constexpr auto fold_table = []() {
+    auto table = std::array<std::uint8_t, 256>();
+    for (int c = 0; c < 256; ++c) {
+        table[c] = ((c >= 'A') && (c <= 'Z')) ? (c - 'A' + 'a') : c;
+    }
+    return table;
+}();
+
+/**
+ * Call `f(key)` with each case folded trigram of `text`, in order.
+ * Trigrams that occur more than once are passed more than once.
+*/
+template<typename F>
+auto for_each_trigram(std::string_view text, F f) -> void {
+    if (text.size() < trigram::trigram_size) {
+        return;
+    }
+    const auto fold = [](const char c) { return std::uint32_t(fold_table[static_cast<unsigned char>(c)]); };
+    auto key = (fold(text[0]) << 8) | fold(text[1]);
+    for (std::size_t j = 2; j < text.size(); ++j) {
+        key = ((key << 8) | fold(text[j])) & (n_trigrams - 1);
+        f(key);
+    }
+}
+
+/**
+ * Get the distinct case folded trigrams of `text`.
+ *
+ * @param grams set to the trigrams, in increasing order.
+*/
+auto get_trigrams(std::string_view text, std::vector<std::uint32_t>& grams) -> void {
+    grams.clear();
+    for_each_trigram(text, [&](const auto key) { grams.push_back(key); });
+    std::ranges::sort(grams);
+    grams.erase(std::unique(std::begin(grams), std::end(grams)), std::end(grams));
+}
+
+/**
+ * Stores smaller than this many bytes are indexed by sorting their
+ * trigrams, rather than with counts of all possible trigrams.  The
+ * tables of counts take 192 MiB, which is about what sorting the
+ * trigrams of a store of this size takes.
+*/
+constexpr std::size_t small_store_size = std::size_t(1) << 24;
+
+/**
+ * Number of bits of the trigrams sorted by each pass of
+ * `sort_by_trigram`.
+*/
+constexpr unsigned int radix_bits = 12;
+
+/**
+ * Sort pairs of trigram and line by trigram, keeping the pairs of
+ * each trigram in the order they are in.
+ *
+ * Trigrams have 24 bits, so this takes two passes of counting sort,
+ * each over `radix_bits` of them.
+*/
+auto sort_by_trigram(std::vector<std::pair<std::uint32_t, std::uint32_t>>& key_lines) -> void {
+    constexpr std::uint32_t mask = (std::uint32_t(1) << radix_bits) - 1;
+    auto sorted = std::vector<std::pair<std::uint32_t, std::uint32_t>>(key_lines.size());
+    auto starts = std::vector<std::size_t>(std::size_t(1) << radix_bits);
+    for (unsigned int shift = 0; shift < 8 * trigram::trigram_size; shift += radix_bits) {
+        std::ranges::fill(starts, 0);
+        for (const auto& [key, line] : key_lines) {
+            ++starts[(key >> shift) & mask];
+        }
+        std::exclusive_scan(std::begin(starts), std::end(starts), std::begin(starts), std::size_t(0));
+        for (const auto& key_line : key_lines) {
+            sorted[starts[(key_line.first >> shift) & mask]++] = key_line;
+        }
+        std::swap(key_lines, sorted);
+    }
+}
+
+/**
+ * Number of lines indexed between checks of the cancel flag.
+*/
+constexpr std::uint32_t cancel_interval = 1 << 12;
+
+} // namespace
+
+/**
+ * Index a small store by sorting the trigrams of all of its lines.
+*/
+auto trigram::build_sorted(const linestore::LineStore& lines) -> Index {
+    auto index = Index();
+    index.n_lines = lines.size();
+
+    auto key_lines = std::vector<std::pair<std::uint32_t, std::uint32_t>>();
+    for (std::uint32_t k = 0; k < lines.size(); ++k) {
+        for_each_trigram(lines.line(k), [&](const auto key) { key_lines.emplace_back(key, k); });
+    }
+    // The pairs are made in line order, so sorting by trigram leaves
+    // each trigram's lines in order, and repeats next to each other.
+    sort_by_trigram(key_lines);
+    key_lines.erase(std::unique(std::begin(key_lines), std::end(key_lines)), std::end(key_lines));
+
+    index.postings.reserve(key_lines.size());
+    for (const auto& [key, line] : key_lines) {
+        if (index.keys.empty() || (index.keys.back() != key)) {
+            if (!index.keys.empty()) {
+                index.offsets.push_back(index.postings.size());
+            }
+            index.keys.push_back(key);
+        }
+        index.postings.push_back(line);
+    }
+    if (!index.keys.empty()) {
+        index.offsets.push_back(index.postings.size());
+    }
+    return index;
+}
+
+auto trigram::Index::get_postings(std::uint32_t key) const -> std::span<const std::uint32_t> {
+    auto it = std::ranges::lower_bound(keys, key);
+    if ((it == std::end(keys)) || (*it != key)) {
+        return {};
+    }
+    const auto j = it - std::begin(keys);
+    return std::span<const std::uint32_t>(postings.data() + offsets[j], offsets[j + 1] - offsets[j]);
+}
+
+auto trigram::Index::find(std::string_view literal) const -> std::optional<std::vector<std::uint32_t>> {
+    if (literal.size() < trigram_size) {
+        return std::nullopt;
+    }
+    auto grams = std::vector<std::uint32_t>();
+    get_trigrams(literal, grams);
+
+    // Start from the shortest posting list, so that the result only
+    // gets smaller.
+    auto lists = std::vector<std::span<const std::uint32_t>>();
+    for (const auto key : grams) {
+        lists.push_back(get_postings(key));
+    }
+    std::ranges::sort(lists, [](const auto& a, const auto& b) { return a.size() < b.size(); });
+    auto lines = std::vector<std::uint32_t>(std::cbegin(lists[0]), std::cend(lists[0]));
+    auto cur = std::vector<std::uint32_t>();
+    for (std::size_t j = 1; (j < lists.size()) && !lines.empty(); ++j) {
+        cur.clear();
+        std::ranges::set_intersection(lines, lists[j], std::back_inserter(cur));
+        std::swap(lines, cur);
+    }
+    return lines;
+}
+
+auto trigram::Index::find_regex(const std::string& pattern) const -> std::optional<std::vector<std::uint32_t>> {
+    return trigram::find_regex(pattern, [this](const auto& literal) { return find(literal); });
+}
+
+auto trigram::find_regex(const std::string& pattern, const std::function<std::optional<std::vector<std::uint32_t>> (const std::string&)>& find) -> std::optional<std::vector<std::uint32_t>> {
+    auto options = re2::RE2::Options();
+    options.set_log_errors(false);
+    auto prefilter = re2::FilteredRE2(trigram_size);
+    int id;
+    if (prefilter.Add(pattern, options, &id) != re2::RE2::NoError) {
+        return std::nullopt;
+    }
+    auto atoms = std::vector<std::string>();
+    prefilter.Compile(&atoms);
+
+    // The regex passes without any literal, so every line may match.
+    // Masks of atoms are used below, so there can't be too many.
+    auto passed = std::vector<int>();
+    prefilter.AllPotentials({}, &passed);
+    if (!passed.empty() || (atoms.size() > 64)) {
+        return std::nullopt;
+    }
+    const auto is_ascii = [](const auto& atom) { return std::ranges::all_of(atom, [](const char c) { return static_cast<unsigned char>(c) < 0x80; }); };
+    if (!std::ranges::all_of(atoms, is_ascii)) {
+        return std::nullopt;
+    }
+
+    auto line_atoms = std::vector<std::pair<std::uint32_t, std::uint64_t>>();
+    for (std::size_t j = 0; j < atoms.size(); ++j) {
+        const auto atom_lines = find(atoms[j]);
+        if (!atom_lines) {
+            return std::nullopt;
+        }
+        for (const auto line : *atom_lines) {
+            line_atoms.emplace_back(line, std::uint64_t(1) << j);
+        }
+    }
+    std::ranges::sort(line_atoms);
+
+    // Lines with the same atoms pass or not alike, so the prefilter
+    // is only run once per set of atoms.
+    auto passes = std::unordered_map<std::uint64_t, bool>();
+    auto lines = std::vector<std::uint32_t>();
+    for (std::size_t j = 0; j < line_atoms.size();) {
+        const auto line = line_atoms[j].first;
+        std::uint64_t mask = 0;
+        for (; (j < line_atoms.size()) && (line_atoms[j].first == line); ++j) {
+            mask |= line_atoms[j].second;
+        }
+        auto [it, inserted] = passes.try_emplace(mask, false);
+        if (inserted) {
+            auto matched = std::vector<int>();
+            for (std::size_t k = 0; k < atoms.size(); ++k) {
+                if ((mask >> k) & 1) {
+                    matched.push_back(k);
+                }
+            }
+            prefilter.AllPotentials(matched, &passed);
+            it->second = !passed.empty();
+        }
+        if (it->second) {
+            lines.push_back(line);
+        }
+    }
+    return lines;
+}
+
+auto trigram::build(const linestore::LineStore& lines, unsigned int n_threads, const std::atomic<bool>* cancel) -> Index {
+    if (lines.n_bytes() < small_store_size) {
+        return build_sorted(lines);
+    }
+
+    auto index = Index();
+    index.n_lines = lines.size();
+    n_threads = std::max(n_threads, 1u);
+    const auto is_cancelled = [&]() { return (cancel != nullptr) && cancel->load(std::memory_order_relaxed); };
+
+    // Each thread goes through all of the lines, but only handles its
+    // part of the trigrams.  Going through the lines is cheap next to
+    // updating the posting lists, and this way no two threads update
+    // the same trigram, and each posting list is filled in line order.
+    // `last_line` skips the repeats of a trigram in a line.
+    auto last_line = std::vector<std::uint32_t>(n_trigrams);
+    const auto for_each_part_trigram = [&](const unsigned int part, const auto f) {
+        for (std::uint32_t k = 0; k < lines.size(); ++k) {
+            if ((k % cancel_interval == 0) && is_cancelled()) {
+                return;
+            }
+            for_each_trigram(lines.line(k), [&](const auto key) {
+                    if ((get_part(key, n_threads) == part) && (last_line[key] != k + 1)) {
+                        last_line[key] = k + 1;
+                        f(k, key);
+                    }
+                    });
+        }
+    };
+
+    auto counts = std::vector<std::uint64_t>(n_trigrams);
+    scheduler::run(n_threads, n_threads, [&](const auto worker, const auto part) {
+            for_each_part_trigram(part, [&](const auto line, const auto key) { ++counts[key]; });
+            });
+    if (is_cancelled()) {
+        return Index();
+    }
+
+    // Keep the trigrams that occur.  From here on, `counts` holds
+    // where the next line of each trigram goes in `postings`.
+    for (std::uint32_t key = 0; key < n_trigrams; ++key) {
+        if (counts[key] > 0) {
+            const auto pos = index.offsets.back();
+            index.keys.push_back(key);
+            index.offsets.push_back(pos + counts[key]);
+            counts[key] = pos;
+        }
+    }
+
+    index.postings.resize(index.offsets.back());
+    std::ranges::fill(last_line, 0);
+    scheduler::run(n_threads, n_threads, [&](const auto worker, const auto part) {
+            for_each_part_trigram(part, [&](const auto line, const auto key) {
+                    index.postings[counts[key]] = line;
+                    ++counts[key];
+                    });
+            });
+    return is_cancelled() ? Index() : std::move(index);
+}
+
+auto trigram::intersect(const std::vector<std::uint32_t>& a, const std::vector<std::uint32_t>& b) -> std::vector<std::uint32_t> {
+    auto lines = std::vector<std::uint32_t>();
+    std::ranges::set_intersection(a, b, std::back_inserter(lines));
+    return lines;
+}
@@ -0,0 +1,146 @@
+#ifndef SUBSEQSEARCH_TRIGRAM_H
+#define SUBSEQSEARCH_TRIGRAM_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "linestore.h"
+
+namespace trigram {
+
+/**
+ * Number of bytes in a trigram.  Literals shorter than this can't be
+ * looked up.
+*/
+constexpr std::size_t trigram_size = 3;
+
+/**
+ * Posting lists of the trigrams of the lines of a store, in the style
+ * of codesearch.
+ *
+ * Trigrams are case folded (ASCII), so lookups find a superset of the
+ * lines that match, whatever the case sensitivity of the query, and
+ * matches have to be checked against the lines.
+ *
+ *   keys: the trigrams that occur, in increasing order.  A trigram is
+ *          stored as its three bytes, first byte highest.
+ *   offsets: the posting list of `keys[j]` is
+ *          `postings[offsets[j], offsets[j + 1])`.
+ *   postings: line ids, increasing in each posting list.
+ *   n_lines: number of lines indexed.
+*/
+class Index {
+    friend auto build(const linestore::LineStore& lines, unsigned int n_threads, const std::atomic<bool>* cancel) -> Index;
+    friend auto build_sorted(const linestore::LineStore& lines) -> Index;
+
+    public:
+        Index() : keys(), offsets{0}, postings(), n_lines(0) {}
+
+        /**
+         * Find the lines that may contain `literal`.
+         *
+         * These are the lines that have all of the trigrams of
+         * `literal`.
+         *
+         * @return ids of the lines in increasing order, or nothing if
+         *      `literal` is shorter than a trigram.
+        */
+        auto find(std::string_view literal) const -> std::optional<std::vector<std::uint32_t>>;
+
+        /**
+         * Find the lines that may match a regex.
+         *
+         * The literals that matches need (and how, eg. `abc` and
+         * either `def` or `ghi`) are taken from the regex with RE2's
+         * prefilter (`re2::FilteredRE2`).  Lines are kept if the
+         * literals they may contain (see `find`) satisfy it.
+         *
+         * The prefilter lowercases literals with Unicode case folding
+         * (eg. `É` to `é`) while the trigrams are folded as ASCII, so
+         * regexes with literals that aren't ASCII aren't looked up.
+         *
+         * @return ids of the lines in increasing order, or nothing if
+         *      the regex doesn't need any literal of at least a
+         *      trigram (eg. `a.c` or `x*`), needs a literal that isn't
+         *      ASCII, or is invalid (see `trigram::find_regex`).
+        */
+        auto find_regex(const std::string& pattern) const -> std::optional<std::vector<std::uint32_t>>;
+
+        /**
+         * @return number of lines indexed.
+        */
+        auto size() const -> std::size_t { return n_lines; }
+
+        /**
+         * @return number of bytes used by the posting lists.
+        */
+        auto n_bytes() const -> std::size_t {
+            return (keys.size() * sizeof(keys[0])) + (offsets.size() * sizeof(offsets[0])) + (postings.size() * sizeof(postings[0]));
+        }
+
+    private:
+        /**
+         * @return the posting list of `key`, which is empty if the
+         *      trigram doesn't occur.
+        */
+        auto get_postings(std::uint32_t key) const -> std::span<const std::uint32_t>;
+
+        std::vector<std::uint32_t> keys;
+        std::vector<std::uint64_t> offsets;
+        std::vector<std::uint32_t> postings;
+        std::size_t n_lines;
+};
+
+/**
+ * Find the lines that may match a regex, given the lines that have
+ * each literal that matches need.
+ *
+ * The literals (of at least `trigram_size` bytes) are taken from the
+ * regex with RE2's prefilter (`re2::FilteredRE2`), lowercased, and
+ * lines are kept if the literals they have satisfy it.
+ *
+ * @param find returns the ids of the lines that have a literal in
+ *      any case (ASCII) in increasing order, or nothing if it can't
+ *      tell.
+ *
+ * @return ids of the lines in increasing order, or nothing if the
+ *      regex doesn't need any literal (eg. `a.c` or `x*`), needs one
+ *      that isn't ASCII or that `find` can't tell, or is invalid.
+*/
+auto find_regex(const std::string& pattern, const std::function<std::optional<std::vector<std::uint32_t>> (const std::string&)>& find) -> std::optional<std::vector<std::uint32_t>>;
+
+/**
+ * Index the lines of a store.
+ *
+ * The trigrams are split between `n_threads` threads, which each go
+ * through the lines twice: once to count the lines of their
+ * trigrams, and once to fill their posting lists.  Small stores are
+ * indexed by one thread (see `build_sorted`).
+ *
+ * @param cancel if set while building, the build stops and the index
+ *      returned is empty.
+*/
+auto build(const linestore::LineStore& lines, unsigned int n_threads = 1, const std::atomic<bool>* cancel = nullptr) -> Index;
+
+/**
+ * Index the lines of a store by sorting all of their trigrams.
+ *
+ * This takes time in the number of trigrams of the lines only, so it
+ * is what `build` uses for small stores.
+*/
+auto build_sorted(const linestore::LineStore& lines) -> Index;
+
+/**
+ * Intersect two increasing lists of line ids.
+*/
+auto intersect(const std::vector<std::uint32_t>& a, const std::vector<std::uint32_t>& b) -> std::vector<std::uint32_t>;
+
+} // namespace trigram
+
+#endif
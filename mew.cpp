@@ -11,6 +11,7 @@
 #include <execution>
 #include <set>
 #include <algorithm>
+#include <numeric>
 #include <sstream>
 #include <vector>
 #include <functional>
@@ -25,15 +26,37 @@
 #include <ncurses.h>
 #include <getopt.h>
 #include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <array>
+#include <deque>
+#include <list>
+#include <cerrno>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <optional>
+#include <string_view>
+#include <cstdint>
+#include <bit>
+#include <unordered_set>
 
 #include "re2/re2.h"
 #include "re2/stringpiece.h"
 
+#include "filecache.h"
+#include "fmindex.h"
+#include "linestore.h"
 #include "lzapi.h"
 #include "querydata.h"
 #include "query_parser.h"
 #include "fuzzy.h"
+#include "scheduler.h"
 #include "scores.h"
+#include "lineindex.h"
+#include "snapshot.h"
 
 namespace qparse = qryparser;
 namespace qdata = qrydata;
@@ -194,10 +217,9 @@ auto clear(T& t) -> void { t.clear(); }
 /**
 */
 template<typename T, typename F>
-auto mapall(std::istream& is, T& t, F f) -> void {
-    str line;
-    while (std::getline(is, line)) {
-        append(t, f(std::move(line)));
+auto mapall(linestore::BlockReader& reader, T& t, F f) -> void {
+    for (auto line = std::string_view(); reader.read_line(line);) {
+        append(t, f(str(line)));
     }
 }
 
@@ -205,6 +227,35 @@ namespace mew {
 
 auto cmd_modes = vec<char>{'F', 'f', 's'};
 
+/**
+ * Minimum time between screen updates (see `draw`).
+*/
+constexpr auto frame_interval = std::chrono::milliseconds(16);
+
+/**
+ * Longest time to wait for more keys before searching while a query
+ * is typed (see `schedule_search`).
+*/
+constexpr auto max_search_delay = std::chrono::milliseconds(150);
+
+/**
+ * Default time that searches may take to be run as a query is typed
+ * (see `get_search_delay`).
+*/
+constexpr auto default_latency_budget = std::chrono::milliseconds(30);
+
+/**
+ * Searches expected to take up to this many latency budgets are still
+ * run as a query is typed, but only once typing pauses.
+*/
+constexpr int debounce_budgets = 10;
+
+/**
+ * Number of items below which searches are run as a query is typed,
+ * until the speed of searches is known.
+*/
+constexpr int default_incremental_thresh = 500000;
+
 class Menu;
 class CommandLine;
 class Mew;
@@ -215,55 +266,256 @@ auto create_keymap(cmap<int, KeyCommand>& user_keymap, cmap<int, int>& remap, bo
 /**
  * Item to show in `Menu`.
  *
- * * text: the string to show.
- * * info: string containing status information.
+ * Items are kept in `Lines`, which also stores their text, so an item
+ * only refers to its line and takes 12 bytes.
+ *
+ * Items are shared by all the menus that show them, so whether an
+ * item is selected is kept by the menu (see `Menu::get_info`).
+ *
+ * * file_id: index of the file the item comes from in `Lines`, if the
+ *   `from_file` flag is set, or of the name of the file its copied
+ *   line comes from, if the `from_source` flag is set.
+ * * line: index of the item's line in its file, or in the text stored
+ *   by `Lines` if it doesn't come from a file.
+ * * flags: bits describing the item.
 */
 class Item {
-    friend auto get_text(const Item& i) -> cstr*;
-    friend auto get_info(const Item& i) -> cstr*;
-    friend auto get_filename(const Item& i) -> cstr*;
-    friend auto get_lineno(const Item& i) -> long;
-    friend auto tostr(const Item& i) -> str;
-    friend auto tostrp(const Item& i) -> const str*;
-    friend auto set_selected(Item& i, bool is_selected) -> void;
+    friend auto get_file_id(const Item& i) -> std::uint32_t;
+    friend auto get_line(const Item& i) -> std::uint32_t;
+    friend auto is_from_file(const Item& i) -> bool;
+    friend auto is_from_source(const Item& i) -> bool;
 
     public:
-        Item(cstr& text) : info("  "), text(text), filename(""), lineno(-1) {}
+        static constexpr std::uint32_t from_file = 1;
+        static constexpr std::uint32_t from_source = 2;
 
-        Item(cstr& text, cstr& filename, long lineno)
-            : info("  "), text(text), filename(filename), lineno(lineno) {}
+        Item(std::uint32_t file_id, std::uint32_t line, std::uint32_t flags)
+            : file_id(file_id), line(line), flags(flags) {}
 
     private:
-        str info;
-        str text;
-        str filename;
-        long lineno;
+        std::uint32_t file_id;
+        std::uint32_t line;
+        std::uint32_t flags;
 };
 
+static_assert(sizeof(Item) == 12);
+
 /**
 */
-auto set_selected(Item& i, bool is_selected) -> void {
-    i.info[0] = is_selected ? '*' : ' ';
-}
+auto get_file_id(const Item& i) -> std::uint32_t { return i.file_id; }
+auto get_line(const Item& i) -> std::uint32_t { return i.line; }
+auto is_from_file(const Item& i) -> bool { return (i.flags & Item::from_file) != 0; }
+auto is_from_source(const Item& i) -> bool { return (i.flags & Item::from_source) != 0; }
 
 /**
+ * Get a number that no earlier call returned, from any thread.
+ *
+ * Numbers start at 1, so 0 can stand for none.
 */
-auto get_text(const Item& i) -> cstr* { return &(i.text); }
-auto get_info(const Item& i) -> cstr* { return &(i.info); }
-auto get_filename(const Item& i) -> cstr* { return &(i.filename); }
-auto get_lineno(const Item& i) -> long { return i.lineno; }
+auto next_generation() -> std::uint64_t {
+    static std::atomic<std::uint64_t> generation = 0;
+    return ++generation;
+}
 
 /**
+ * Items and the text they refer to.
+ *
+ * Text added with `add_text` is copied to a single arena.  Lines of
+ * files are not copied: the files (eg. the ones kept by
+ * `filecache::FileCache`) are shared, and each is kept once no matter
+ * how many of its lines are added, so filenames aren't repeated per
+ * item either.
+ *
+ * Lines copied from files that aren't kept as lines (eg. compressed
+ * ones) are added with `add_source_line`, which keeps the name of
+ * their file and their line number along with the copy.
+ *
+ * Text is null byte terminated, so `get_text(l, j).data()` can be
+ * passed to functions that expect C strings.
+ *
+ * * items: the items.
+ * * text: the arena of the items that don't come from files.
+ * * files: the files items come from.
+ * * file_ids: index in `files` of each file.
+ * * sources: names of the files that copied lines come from.
+ * * source_ids: index in `sources` of each name.
+ * * source_lines: index in its file of each line of the arena, for
+ *   the lines copied from files (and up to the last of them).
+ * * generation: number telling these items apart from the ones of
+ *   any other `Lines`, even one allocated where these were (see
+ *   `next_generation`).  Items are only ever added, so it holds as
+ *   they grow.
 */
-auto tostr(const Item& i) -> str {return i.text;}
+class Lines {
+    friend auto get_size(const Lines& l) -> int;
+    friend auto get_text(const Lines& l, int j) -> std::string_view;
+    friend auto get_filename(const Lines& l, int j) -> cstr*;
+    friend auto get_lineno(const Lines& l, int j) -> long;
+    friend auto add_text(Lines& l, std::string_view text) -> void;
+    friend auto add_texts(Lines& l, const linestore::LineStore& texts) -> void;
+    friend auto add_line(Lines& l, const std::shared_ptr<const linestore::LineStore>& file, long line) -> void;
+    friend auto add_source_line(Lines& l, cstr& filename, long line, std::string_view text) -> void;
+    friend auto load_text(Lines& l, const linestore::LineStore& text) -> void;
+    friend auto get_arena(const Lines& l) -> const linestore::LineStore&;
+    friend auto get_generation(const Lines& l) -> std::uint64_t;
+    friend auto get_n_bytes(const Lines& l) -> std::size_t;
+
+    public:
+        Lines() : items(), text(), files(), file_ids(), sources(), source_ids(), source_lines(), generation(next_generation()) {}
+
+    private:
+        vec<Item> items;
+        linestore::LineStore text;
+        vec<std::shared_ptr<const linestore::LineStore>> files;
+        map<const linestore::LineStore*, std::uint32_t> file_ids;
+        vec<str> sources;
+        map<str, std::uint32_t> source_ids;
+        vec<std::uint32_t> source_lines;
+        std::uint64_t generation;
+};
 
 /**
 */
-auto newItem(cstr& text) -> Item { return Item(text); }
+auto get_size(const Lines& l) -> int { return len(l.items); }
 
 /**
-*/
-auto tostrp(const Item& i) -> const str* {return &(i.text);}
+ * Get the text of the `j`th item.
+ */
+auto get_text(const Lines& l, int j) -> std::string_view {
+    const auto& item = l.items[j];
+    if (is_from_file(item)) {
+        return l.files[get_file_id(item)]->line(get_line(item));
+    }
+    return l.text.line(get_line(item));
+}
+
+/**
+ * Get the name of the file the `j`th item comes from.
+ *
+ * @return the filename, or an empty string if the item doesn't come
+ *      from a file.
+ */
+auto get_filename(const Lines& l, int j) -> cstr* {
+    static cstr no_filename = "";
+    const auto& item = l.items[j];
+    if (is_from_source(item)) {
+        return &l.sources[get_file_id(item)];
+    }
+    return is_from_file(item) ? &l.files[get_file_id(item)]->get_name() : &no_filename;
+}
+
+/**
+ * Get the line number (starting at 1) of the `j`th item in its file.
+ *
+ * @return the line number, or -1 if the item doesn't come from a
+ *      file.
+ */
+auto get_lineno(const Lines& l, int j) -> long {
+    const auto& item = l.items[j];
+    if (is_from_source(item)) {
+        return long(l.source_lines[get_line(item)]) + 1;
+    }
+    return is_from_file(item) ? long(get_line(item)) + 1 : -1;
+}
+
+/**
+ * Add an item with a copy of `text`.
+ */
+auto add_text(Lines& l, std::string_view text) -> void {
+    append(l.items, Item(0, l.text.size(), 0));
+    l.text.append(text.data(), len(text));
+}
+
+/**
+ * Add an item with a copy of each line of `texts`.
+ *
+ * The arena and offsets of `texts` are appended at once, rather than
+ * line by line.
+ */
+auto add_texts(Lines& l, const linestore::LineStore& texts) -> void {
+    const auto base = l.text.size();
+    l.text.append(texts);
+    l.items.reserve(len(l.items) + texts.size());
+    for (std::size_t j = 0; j < texts.size(); ++j) {
+        append(l.items, Item(0, base + j, 0));
+    }
+}
+
+/**
+ * Add the `line`th line of `file` as an item.
+ */
+auto add_line(Lines& l, const std::shared_ptr<const linestore::LineStore>& file, long line) -> void {
+    auto [it, inserted] = l.file_ids.try_emplace(file.get(), len(l.files));
+    if (inserted) {
+        append(l.files, file);
+    }
+    append(l.items, Item(it->second, line, Item::from_file));
+}
+
+/**
+ * Add an item with a copy of `text`, the `line`th line of the file
+ * `filename`.
+ */
+auto add_source_line(Lines& l, cstr& filename, long line, std::string_view text) -> void {
+    auto [it, inserted] = l.source_ids.try_emplace(filename, len(l.sources));
+    if (inserted) {
+        append(l.sources, filename);
+    }
+    l.source_lines.resize(l.text.size());
+    append(l.source_lines, std::uint32_t(line));
+    append(l.items, Item(it->second, l.text.size(), Item::from_source));
+    l.text.append(text.data(), len(text));
+}
+
+/**
+ * Replace the items with the lines of `text`.
+ *
+ * The arena becomes a copy of `text`, so if it is mapped (see
+ * `linestore::load_mapped`), the lines are not copied.
+ */
+auto load_text(Lines& l, const linestore::LineStore& text) -> void {
+    l = Lines();
+    l.text = text;
+    l.items.reserve(text.size());
+    for (std::size_t j = 0; j < text.size(); ++j) {
+        append(l.items, Item(0, j, 0));
+    }
+}
+
+/**
+ * Get the arena of the items that don't come from files, in the
+ * order they were added.
+ */
+auto get_arena(const Lines& l) -> const linestore::LineStore& { return l.text; }
+
+/**
+ * Get the number telling these items apart from others.
+ */
+auto get_generation(const Lines& l) -> std::uint64_t { return l.generation; }
+
+/**
+ * Estimate the memory that items use besides the files they share.
+ *
+ * This counts an `Item` per item and the arena (ie. the text and
+ * offsets of the lines added by copy) along with the line numbers of
+ * copied lines.
+ */
+auto get_n_bytes(const Lines& l) -> std::size_t {
+    const auto& arena = l.text;
+    return len(l.items) * sizeof(Item) + arena.n_bytes() + arena.get_offsets().size() * sizeof(std::uint64_t)
+        + len(l.source_lines) * sizeof(std::uint32_t);
+}
+
+/**
+ * @return items with a copy of each string of `strings`.
+ */
+auto to_lines(cvec<str>& strings) -> Lines {
+    auto lines = Lines();
+    for (const auto& s : strings) {
+        add_text(lines, s);
+    }
+    return lines;
+}
 
 /**
  * Attributes associated with substrings of an `Item`.
@@ -303,36 +555,389 @@ auto translate(const ItemAttr& i, int start) -> std::tuple<int, int> {
     return {attr_beg, attr_end};
 }
 
-using Lines = vec<Item>;
-using LineAttrs = vec<vec<ItemAttr>>;
-using MenuData = std::tuple<Lines, LineAttrs>;
+/**
+ * Characters that split items into words, for searches and the token
+ * index (see `tokenindex::Index`).
+*/
+const str word_delims = ":;,./-_ \t";
+
+/**
+ * Arguments of fuzzy searches.
+ *
+ * @param topk number of best matches to keep.
+*/
+auto make_search_args(cstr& pattern, bool parallel, int topk = 100) -> qdata::SearchArgs {
+    return qdata::SearchArgs{
+        .q=pattern,
+        .ignore_case=true,
+        .smart_case=true,
+        .topk=topk,
+        .filenames=vec<str>(),
+        .parallel=parallel,
+        .preserve_order=false,
+        .batch_size=10000,
+        .max_symbol_dist=10,
+        .gap_penalty="linear",
+        .word_delims=word_delims,
+        .show_color=false,
+    };
+}
+
+/**
+ * Finds the substrings of items to highlight for a search.
+ *
+ * Searches don't keep the positions of their matches.  They are found
+ * again when an item is drawn, so only the rows on screen ever have
+ * attributes, however many items matched.  Each run of consecutive
+ * matching characters gets a single attribute.
+ *
+ * Fuzzy queries keep scratch space, so a highlighter must only be
+ * used by one thread (the one drawing the menu).
+ *
+ * * re: the regex of regex searches.
+ * * search_args: arguments the query was parsed from.
+ * * query: the query of fuzzy searches.
+*/
+class Highlighter {
+    friend auto get_attrs(Highlighter& h, std::string_view text) -> vec<ItemAttr>;
+
+    public:
+        /**
+         * @param pattern the search pattern.
+         * @param regex whether `pattern` is a regex (otherwise it is
+         *      a fuzzy query).
+        */
+        Highlighter(cstr& pattern, bool regex) : re(), search_args(make_search_args(pattern, false)), query() {
+            if (regex) {
+                re = std::make_unique<re2::RE2>("(" + pattern + ")");
+            }
+            else {
+                query = std::make_unique<qparse::Query<scores::LinearScorer>>(
+                        qparse::getparse<scores::LinearScorer>(search_args));
+            }
+        }
+
+    private:
+        std::unique_ptr<re2::RE2> re;
+        qdata::SearchArgs search_args;
+        std::unique_ptr<qparse::Query<scores::LinearScorer>> query;
+};
+
+/**
+ * Get the attributes of the matches of a search in `text`.
+ *
+ * @return one attribute per run of matching characters, in order.
+*/
+auto get_attrs(Highlighter& h, std::string_view text) -> vec<ItemAttr> {
+    auto attrs = vec<ItemAttr>();
+    if (h.re != nullptr) {
+        auto match = re2::StringPiece();
+        if (RE2::PartialMatch(re2::StringPiece(text.data(), len(text)), *h.re, &match)) {
+            long unsigned int beg = match.data() - text.data();
+            append(attrs, ItemAttr(beg, beg + len(match), COLOR_PAIR(2)));
+        }
+        return attrs;
+    }
+
+    // The match found by `is_match` is kept as positions in the string,
+    // so both need the same copy of the text.
+    const auto haystack = str(text);
+    if (not h.query->fuzzy->is_match(haystack.data(), len(haystack))) {
+        return attrs;
+    }
+    auto path = h.query->fuzzy->calc_score(haystack).path;
+    std::ranges::sort(path);
+    for (std::size_t j = 0; j < len(path);) {
+        auto k = j + 1;
+        while ((k < len(path)) and (path[k] <= (path[k - 1] + 1))) {
+            ++k;
+        }
+        append(attrs, ItemAttr(path[j], path[k - 1] + 1, COLOR_PAIR(2)));
+        j = k;
+    }
+    return attrs;
+}
+
+/**
+ * Items to show in a menu.
+ *
+ * This is a view of items that can be shared with other views.  The
+ * input is stored once no matter how many menus show parts of it, and
+ * copying a view (eg. to switch menus or keep it in the history) takes
+ * constant time.
+ *
+ * * items: the items viewed.
+ * * indices: indices in `items` of the items shown, in order.  If
+ *   null, the first `size` items are shown.
+ * * highlighter: finds the attributes of the items shown, or null if
+ *   there are none.
+ * * size: number of items shown.
+ * * generation: number telling what is shown apart from what other
+ *   views show: the generation of the items for views without
+ *   indices, and a new one for views with indices.
+*/
+class MenuData {
+    friend auto get_size(const MenuData& md) -> int;
+    friend auto get_text(const MenuData& md, int j) -> std::string_view;
+    friend auto get_filename(const MenuData& md, int j) -> cstr*;
+    friend auto get_lineno(const MenuData& md, int j) -> long;
+    friend auto get_index(const MenuData& md, int j) -> int;
+    friend auto get_attrs(const MenuData& md, int j) -> vec<ItemAttr>;
+    friend auto get_items(const MenuData& md) -> const std::shared_ptr<const Lines>&;
+    friend auto get_indices(const MenuData& md) -> cvec<int>*;
+    friend auto get_highlighter(const MenuData& md) -> const std::shared_ptr<Highlighter>&;
+    friend auto get_n_bytes(const MenuData& md) -> std::size_t;
+    friend auto get_generation(const MenuData& md) -> std::uint64_t;
+    friend auto extend(MenuData& md, int size) -> void;
+
+    public:
+        MenuData() : items(std::make_shared<const Lines>()), indices(), highlighter(), size(0), generation(get_generation(*items)) {}
+
+        /**
+         * View the first `size` items of `items`.
+        */
+        MenuData(std::shared_ptr<const Lines> items, int size, std::shared_ptr<Highlighter> highlighter = nullptr)
+            : items(std::move(items)), indices(), highlighter(std::move(highlighter)), size(size), generation(get_generation(*this->items)) {}
+
+        /**
+         * View some of `items`.
+         *
+         * @param indices indices of the items to show.
+         * @param highlighter finds the attributes of the items
+         *      shown, if any.
+        */
+        MenuData(std::shared_ptr<const Lines> items, vec<int>&& indices, std::shared_ptr<Highlighter> highlighter)
+            : items(std::move(items)), indices(), highlighter(std::move(highlighter)), size(len(indices)), generation(next_generation()) {
+            this->indices = std::make_shared<const vec<int>>(std::move(indices));
+        }
+
+        /**
+         * View new items.
+         *
+         * @param highlighter finds the attributes of the items, if
+         *      any.
+        */
+        MenuData(Lines&& items, std::shared_ptr<Highlighter> highlighter)
+            : items(), indices(), highlighter(std::move(highlighter)), size(get_size(items)), generation(get_generation(items)) {
+            this->items = std::make_shared<const Lines>(std::move(items));
+        }
+
+    private:
+        std::shared_ptr<const Lines> items;
+        std::shared_ptr<const vec<int>> indices;
+        std::shared_ptr<Highlighter> highlighter;
+        int size;
+        std::uint64_t generation;
+};
+
+/**
+*/
+auto get_size(const MenuData& md) -> int { return md.size; }
+
+/**
+ * Get the index in the viewed items of the `j`th item shown.
+ */
+auto get_index(const MenuData& md, int j) -> int {
+    return md.indices == nullptr ? j : (*md.indices)[j];
+}
+
+/**
+ * Get the text of the `j`th item shown.
+ */
+auto get_text(const MenuData& md, int j) -> std::string_view {
+    return get_text(*md.items, get_index(md, j));
+}
+
+/**
+ * Get the name of the file the `j`th item shown comes from.
+ */
+auto get_filename(const MenuData& md, int j) -> cstr* {
+    return get_filename(*md.items, get_index(md, j));
+}
+
+/**
+ * Get the line number of the `j`th item shown in its file.
+ */
+auto get_lineno(const MenuData& md, int j) -> long {
+    return get_lineno(*md.items, get_index(md, j));
+}
+
+/**
+ * Get the attributes of the `j`th item shown.
+ *
+ * These are found when called (see `Highlighter`), so this is meant
+ * for the items on screen.
+ */
+auto get_attrs(const MenuData& md, int j) -> vec<ItemAttr> {
+    return md.highlighter == nullptr ? vec<ItemAttr>() : get_attrs(*md.highlighter, get_text(md, j));
+}
+
+/**
+ * Get the items viewed.
+ */
+auto get_items(const MenuData& md) -> const std::shared_ptr<const Lines>& { return md.items; }
+
+/**
+ * Get the indices in the viewed items of the items shown.
+ *
+ * @return the indices, or nullptr if the first `get_size(md)` items
+ *      are shown.
+ */
+auto get_indices(const MenuData& md) -> cvec<int>* { return md.indices.get(); }
+
+/**
+ * Get what finds the attributes of the items shown.
+ *
+ * @return the highlighter, or nullptr if items have no attributes.
+ */
+auto get_highlighter(const MenuData& md) -> const std::shared_ptr<Highlighter>& { return md.highlighter; }
+
+/**
+ * Estimate the memory that a view uses besides what it shares.
+ *
+ * A view with indices costs its indices.  One without is taken to own
+ * its items (eg. the matches of a search in files), and costs them and
+ * the text copied with them (see `get_n_bytes(const Lines&)`).
+ */
+auto get_n_bytes(const MenuData& md) -> std::size_t {
+    return (md.indices != nullptr) ? md.size * sizeof(int) : get_n_bytes(*md.items);
+}
+
+/**
+ * Get the number telling what a view shows apart from what other
+ * views show.
+ *
+ * Views with the same generation and size show the same items, even
+ * if the first one was freed before the second was made.  Views
+ * without indices of items that grew keep their generation.
+ */
+auto get_generation(const MenuData& md) -> std::uint64_t { return md.generation; }
+
+/**
+ * Show the first `size` viewed items.
+ *
+ * This is for views of the first items (ie, without indices) whose
+ * items grew.
+ */
+auto extend(MenuData& md, int size) -> void { md.size = size; }
+
 using LineGetter = std::function<MenuData (cstr&)>;
+using FileData = vec<std::shared_ptr<const linestore::LineStore>>;
+using FileKeys = vec<std::optional<std::pair<std::int64_t, std::int64_t>>>;
+using CompressedData = vec<std::shared_ptr<const fmindex::Index>>;
+
+/**
+ * Shows the provisional results of a search that is still running.
+*/
+using SearchProgress = std::function<void (MenuData&&)>;
+
+/**
+ * A search run by a `SearchWorker`.
+ *
+ * It is given a flag that is set when it is cancelled, and a function
+ * to show provisional results with.
+*/
+using SearchFn = std::function<MenuData (const std::atomic<bool>&, const SearchProgress&)>;
 
 auto make_interactive_cmd(str cmd) -> KeyCommand;
 auto make_populatemenu_cmd(str cmd) -> KeyCommand;
-auto find_regex_parallel(cvec<Item>& items, cstr& pattern) -> MenuData;
-auto find_regex_files_parallel(cvec<str>& filenames, cstr& pattern) -> MenuData;
+auto find_regex_parallel(const MenuData& items, cstr& pattern, const std::atomic<bool>* cancel, const lineindex::Indexer* indexer) -> MenuData;
+auto find_regex_files_parallel(const FileData& files, cstr& pattern, const std::atomic<bool>* cancel, const lineindex::Indexer* indexer) -> MenuData;
+
+/**
+ * A list of indices stored in few bytes.
+ *
+ * Each index is stored as its difference to the previous index,
+ * zigzag encoded so that it isn't negative, in 7 bit groups (the high
+ * bit of a byte is set if more bytes follow).  Regex matches are in
+ * item order, so most of their indices take a single byte, and fuzzy
+ * matches (in score order) take a few.
+*/
+class IndexList {
+    friend auto get_size(const IndexList& l) -> int;
+    friend auto decode(const IndexList& l) -> vec<int>;
+
+    public:
+        IndexList() : bytes(), size(0) {}
+
+        explicit IndexList(cvec<int>& indices) : bytes(), size(len(indices)) {
+            long prev = 0;
+            for (const auto index : indices) {
+                const long delta = index - prev;
+                auto zigzag = static_cast<unsigned long>((delta << 1) ^ (delta >> 63));
+                while (zigzag >= 0x80) {
+                    append(bytes, static_cast<std::uint8_t>(zigzag | 0x80));
+                    zigzag >>= 7;
+                }
+                append(bytes, static_cast<std::uint8_t>(zigzag));
+                prev = index;
+            }
+            bytes.shrink_to_fit();
+        }
+
+    private:
+        vec<std::uint8_t> bytes;
+        int size;
+};
+
+/**
+*/
+auto get_size(const IndexList& l) -> int { return l.size; }
 
 /**
+ * @return the indices in `l`.
 */
-auto newItemAttr(long unsigned int idx) -> ItemAttr {
-    return ItemAttr(idx, idx + 1, COLOR_PAIR(2));
-            //cur_attrs.emplace_back(mew::ItemAttr{aj, aj + 1, A_REVERSE});
+auto decode(const IndexList& l) -> vec<int> {
+    auto indices = newVecReserve<int>(l.size);
+    long prev = 0;
+    for (std::size_t j = 0; j < len(l.bytes);) {
+        unsigned long zigzag = 0;
+        for (int shift = 0; ; shift += 7) {
+            const auto byte = l.bytes[j++];
+            zigzag |= static_cast<unsigned long>(byte & 0x7f) << shift;
+            if (byte < 0x80) {
+                break;
+            }
+        }
+        prev += static_cast<long>(zigzag >> 1) ^ -static_cast<long>(zigzag & 1);
+        append(indices, static_cast<int>(prev));
+    }
+    return indices;
 }
 
 /**
+ * A menu kept in the history.
+ *
+ * Only what is needed to show the menu again is kept: the viewed
+ * items (shared with the menus that show them), the indices of the
+ * items shown as an `IndexList`, the search or command that made the
+ * menu, and its `Highlighter`.  No attributes are kept, so the memory
+ * used by the history doesn't grow with the size of the matches.
 */
 class MenuHistoryElem {
-    friend auto get_data(const MenuHistoryElem& m) -> const MenuData*;
+    friend auto get_data(const MenuHistoryElem& m) -> MenuData;
     friend auto get_text(const MenuHistoryElem& m) -> cstr*;
 
     public:
-        MenuHistoryElem(MenuData&& md, cstr& text)
-            : menu_data(md), text(text) {}
+        /**
+         * @param md the menu.
+         * @param text the search or command that made the menu.
+        */
+        MenuHistoryElem(const MenuData& md, cstr& text)
+            : items(get_items(md)), indices(), has_indices(false), size(get_size(md)), text(text), highlighter(get_highlighter(md)) {
+            if (auto md_indices = get_indices(md); md_indices != nullptr) {
+                indices = IndexList(*md_indices);
+                has_indices = true;
+            }
+        }
 
     private:
-        MenuData menu_data;
+        std::shared_ptr<const Lines> items;
+        IndexList indices;
+        bool has_indices;
+        int size;
         str text;
+        std::shared_ptr<Highlighter> highlighter;
 };
 
 /**
@@ -340,9 +945,13 @@ class MenuHistoryElem {
 auto get_text(const MenuHistoryElem& m) -> cstr* { return &(m.text); }
 
 /**
+ * Get the menu back.
 */
-auto get_data(const MenuHistoryElem& m) -> const MenuData* {
-    return &(m.menu_data);
+auto get_data(const MenuHistoryElem& m) -> MenuData {
+    if (m.has_indices) {
+        return MenuData(m.items, decode(m.indices), m.highlighter);
+    }
+    return MenuData(m.items, m.size, m.highlighter);
 }
 
 /**
@@ -362,6 +971,7 @@ class Scroller {
     friend auto scrolled(const Scroller& s) -> bool;
     friend auto repos(Scroller& s, int c) -> void;
     friend auto resize(Scroller& s, int data_end) -> void;
+    friend auto resize(Scroller& s, int cursor_max, int data_end) -> void;
 
     public:
         Scroller() {}
@@ -486,6 +1096,19 @@ class Scroller {
 
 auto resize(Scroller& s, int data_end) -> void { s.data_end = data_end; }
 
+/**
+ * Change the maximum cursor position and the data size, keeping the
+ * cursor on the same data element.
+ */
+auto resize(Scroller& s, int cursor_max, int data_end) -> void {
+    s.cursor_max = cursor_max;
+    s.data_end = data_end;
+    if (s.cursor >= cursor_max) {
+        s.data_beg += s.cursor - cursor_max + 1;
+        s.cursor = cursor_max - 1;
+    }
+}
+
 auto current(const Scroller& s) -> std::tuple<int, int, int> {
     return {s.cursor, s.data_beg, s.data_idx};
 }
@@ -541,23 +1164,124 @@ auto prev(Scroller& s) -> std::tuple<int, int, int> {
 }
 
 /**
- * A scrollable menu.
+ * Selected items of a `Lines`, one bit per item.
  *
- * Items to show are set with `set_items`.  This takes strings
- * and ncurses attributes to show for regions of those strings
- * (eg. color, bold, etc.).
+ * Ranges of items are selected (or unselected, or inverted) a 64 bit
+ * word at a time, so that selecting a million items takes
+ * microseconds.  The bits grow with the items.
 */
-class Menu {
-    friend auto prev(Menu& m) -> void;
-    friend auto next(Menu& m) -> void;
-    friend auto current(const Menu& m) -> cstr*;
-    friend auto getall(const Menu& m) -> cvec<Item>*;
+class Selection {
+    friend auto is_selected(const Selection& s, int j) -> bool;
+    friend auto toggle(Selection& s, int j) -> void;
+    friend auto set_range(Selection& s, int beg, int end, bool selected) -> void;
+    friend auto invert_range(Selection& s, int beg, int end) -> void;
+    template<typename F>
+    friend auto forall_selected(const Selection& s, F f) -> void;
+
+    public:
+        Selection() : words() {}
+
+    private:
+        /**
+         * Make room for items `[0, end)`.
+        */
+        auto reserve(int end) -> void {
+            if (auto n_words = (std::size_t(end) + 63) / 64; n_words > len(words)) {
+                words.resize(n_words, 0);
+            }
+        }
+
+        /**
+         * Apply `f(word, mask)` to the words of items `[beg, end)`,
+         * with the bits of those items set in `mask`.
+        */
+        template<typename F>
+        auto for_range(int beg, int end, F f) -> void {
+            if (beg >= end) {
+                return;
+            }
+            reserve(end);
+            const auto first = std::size_t(beg) / 64;
+            const auto last = std::size_t(end - 1) / 64;
+            for (auto j = first; j <= last; ++j) {
+                auto mask = ~std::uint64_t(0);
+                if (j == first) {
+                    mask &= ~std::uint64_t(0) << (beg % 64);
+                }
+                if (j == last) {
+                    mask &= ~std::uint64_t(0) >> (63 - ((end - 1) % 64));
+                }
+                f(words[j], mask);
+            }
+        }
+
+        vec<std::uint64_t> words;
+};
+
+/**
+*/
+auto is_selected(const Selection& s, int j) -> bool {
+    return ((std::size_t(j) / 64) < len(s.words)) and ((s.words[j / 64] >> (j % 64)) & 1);
+}
+
+/**
+*/
+auto toggle(Selection& s, int j) -> void {
+    s.reserve(j + 1);
+    s.words[j / 64] ^= std::uint64_t(1) << (j % 64);
+}
+
+/**
+ * Select (or unselect) items `[beg, end)`.
+*/
+auto set_range(Selection& s, int beg, int end, bool selected) -> void {
+    s.for_range(beg, end, [selected](auto& word, const auto mask) {
+            word = selected ? (word | mask) : (word & ~mask);
+            });
+}
+
+/**
+ * Invert the selection of items `[beg, end)`.
+*/
+auto invert_range(Selection& s, int beg, int end) -> void {
+    s.for_range(beg, end, [](auto& word, const auto mask) { word ^= mask; });
+}
+
+/**
+ * Call `f(j)` with the index `j` of every selected item, in order.
+*/
+template<typename F>
+auto forall_selected(const Selection& s, F f) -> void {
+    for (std::size_t j = 0; j < len(s.words); ++j) {
+        for (auto word = s.words[j]; word != 0; word &= word - 1) {
+            f(int(64 * j + std::countr_zero(word)));
+        }
+    }
+}
+
+/**
+ * A scrollable menu.
+ *
+ * Items to show are set with `set_items`.  This takes strings
+ * and ncurses attributes to show for regions of those strings
+ * (eg. color, bold, etc.).
+*/
+class Menu {
+    friend auto prev(Menu& m) -> void;
+    friend auto next(Menu& m) -> void;
+    friend auto current(const Menu& m) -> std::optional<std::string_view>;
+    friend auto getall(const Menu& m) -> const MenuData*;
     friend auto resize(Menu& m, const std::tuple<int, int, int>& bounds) -> void;
-    friend auto setall(Menu& m, cvec<Item>& items, cvec2d<ItemAttr>& attrs) -> void;
+    friend auto setall(Menu& m, const MenuData& data) -> void;
+    friend auto extend(Menu& m, int size) -> void;
+    friend auto get_version(const Menu& m) -> int;
     friend auto toggle_selection(Menu& m) -> void;
     friend auto toggle_selection(Menu& m, int line) -> void;
     friend auto toggle_info(Menu& m) -> void;
     friend auto get_selections(const Menu& m) -> vec<str>;
+    friend auto write_selections(const Menu& m, int fd) -> bool;
+    friend auto select_all(Menu& m, bool selected) -> void;
+    friend auto invert_selection(Menu& m) -> void;
 
     public:
         Menu() {}
@@ -569,12 +1293,80 @@ class Menu {
          * @param bounds bounds of the menu given as
          *      `(first row, last row, num of columns)`.
         */
-        Menu(WINDOW* window, const std::tuple<int, int, int>& bounds) : first_line(std::get<0>(bounds)), last_line(std::get<1>(bounds)), window(window), items(), item_attrs(), selected_items(), n_lines(last_line - first_line), n_cols(std::get<2>(bounds)), show_info(false) {
+        Menu(WINDOW* window, const std::tuple<int, int, int>& bounds) : first_line(std::get<0>(bounds)), last_line(std::get<1>(bounds)), window(window), data(), selections(), n_lines(last_line - first_line), n_cols(std::get<2>(bounds)), show_info(false), version(0) {
             scroller = Scroller(n_lines, 0);
         }
 
     private:
 
+        /**
+         * Get the selected items of the items that `data` views.
+         *
+         * @return indices of the selected items, or nullptr if none
+         *      were ever selected.
+        */
+        auto get_selected(const std::shared_ptr<const Lines>& items) const -> const Selection* {
+            for (const auto& [cur_items, selected] : selections) {
+                if (cur_items == items) {
+                    return &selected;
+                }
+            }
+            return nullptr;
+        }
+
+        /**
+         * Get the selected items of the items that `data` views,
+         * starting a selection if there is none.
+        */
+        auto get_selected() -> Selection& {
+            const auto& items = get_items(data);
+            auto it = std::ranges::find_if(selections, [&](const auto& s) { return s.first == items; });
+            if (it == std::end(selections)) {
+                selections.emplace_back(items, Selection());
+                it = std::end(selections) - 1;
+            }
+            return it->second;
+        }
+
+        /**
+         * Apply `f(selection, beg, end)` to the items shown, as ranges
+         * of indices in the viewed items.
+        */
+        template<typename F>
+        auto for_shown(F f) -> void {
+            auto& selected = get_selected();
+            if (get_indices(data) == nullptr) {
+                f(selected, 0, get_size(data));
+                return;
+            }
+            for (const auto item_idx : *get_indices(data)) {
+                f(selected, item_idx, item_idx + 1);
+            }
+        }
+
+        /**
+         * Redraw the rows shown.
+        */
+        auto redraw() -> void {
+            if (auto [c, db, di] = current(scroller); get_size(data) > 0) {
+                show_items(db, std::min(get_size(data) - db, n_lines), c, di, show_info);
+            }
+        }
+
+        /**
+         * Get the status info of the `item_idx`th item (a star if it
+         * is selected).
+        */
+        auto get_info(int item_idx) const -> cstr* {
+            static cstr selected_info = "* ";
+            static cstr unselected_info = "  ";
+            auto selected = get_selected(get_items(data));
+            if ((selected != nullptr) and is_selected(*selected, get_index(data, item_idx))) {
+                return &selected_info;
+            }
+            return &unselected_info;
+        }
+
         /**
          * Highlight row `line`, which points to the `idx`th item.
         */
@@ -599,21 +1391,21 @@ class Menu {
         auto draw_status(int item_idx, int line_idx) -> void {
             wmove(window, line_idx, 0);
             wclrtoeol(window);
-            waddnstr(window, get_info(items[item_idx])->c_str(), len(get_info(items[item_idx])));
+            waddnstr(window, get_info(item_idx)->c_str(), len(get_info(item_idx)));
         }
 
         /**
          * Get the index of the `item_idx`th item's string from which
          * to start displaying.  The index is such that the last
-         * character of the last attribute is shown in the last
-         * column.
+         * character of the last attribute (of `attrs`) is shown in
+         * the last column.
         */
-        auto get_item_start(int item_idx) -> int {
-            if (len(item_attrs) != len(items)) {
+        auto get_item_start(int item_idx, cvec<ItemAttr>& attrs) -> int {
+            if (std::empty(attrs)) {
                 return 0;
             }
-            auto n_cols_after_info = n_cols - len(get_info(items[item_idx]));
-            auto last_end = getend(item_attrs[item_idx].back());
+            auto n_cols_after_info = n_cols - len(get_info(item_idx));
+            auto last_end = getend(attrs.back());
             if (last_end > n_cols_after_info) {
                 return last_end - n_cols_after_info;
                 // Uncomment to have the last attribute shown in the
@@ -624,17 +1416,14 @@ class Menu {
         }
 
         /**
-         * Draw attributes of the `item_idx`th item which is currently
-         * shown at row `line_idx`.  The string `str` needs to be the
-         * item's string offset by `start` (ie, `text.c_str() + start`).
+         * Draw attributes `item_attrs` of the `item_idx`th item which
+         * is currently shown at row `line_idx`.  The string `str`
+         * needs to be the item's string offset by `start` (ie,
+         * `text.c_str() + start`).
         */
-        auto draw_item_attrs(const char* str, int line_idx, int item_idx, int start) -> void {
-            if (len(item_attrs) != len(items)) {
-                return;
-            }
-
-            auto info_len = len(get_info(items[item_idx]));
-            for (const auto& attrs : item_attrs[item_idx]) {
+        auto draw_item_attrs(const char* str, int line_idx, int item_idx, int start, cvec<ItemAttr>& item_attrs) -> void {
+            auto info_len = len(get_info(item_idx));
+            for (const auto& attrs : item_attrs) {
                 if (getend(attrs) < start) {
                     continue;
                 }
@@ -655,16 +1444,18 @@ class Menu {
         auto show_item(int item_idx, int line_idx, bool info = false) -> void {
             draw_status(item_idx, line_idx);
 
-            int start = get_item_start(item_idx);
-            auto str = get_text(items[item_idx])->c_str() + start;
-            auto info_len = len(get_info(items[item_idx]));
+            const auto attrs = info ? vec<ItemAttr>() : get_attrs(data, item_idx);
+            int start = get_item_start(item_idx, attrs);
+            auto str = get_text(data, item_idx).data() + start;
+            auto info_len = len(get_info(item_idx));
 
             if (info) {
                 wmove(window, line_idx, info_len);
-                str = get_filename(items[item_idx])->c_str();
-                auto lineno = std::to_string(get_lineno(items[item_idx]));
-                if (len(*get_filename(items[item_idx])) > (n_cols - info_len - len(lineno) - 1)) {
-                    str += len(*get_filename(items[item_idx])) - (n_cols - info_len - len(lineno) - 1);
+                const auto& filename = *get_filename(data, item_idx);
+                str = filename.c_str();
+                auto lineno = std::to_string(get_lineno(data, item_idx));
+                if (len(filename) > (n_cols - info_len - len(lineno) - 1)) {
+                    str += len(filename) - (n_cols - info_len - len(lineno) - 1);
                 }
                 waddnstr(window, lineno.c_str(), n_cols - info_len);
                 waddnstr(window, " " , n_cols - info_len);
@@ -675,17 +1466,30 @@ class Menu {
 
             wmove(window, line_idx, info_len);
             waddnstr(window, str, n_cols - info_len);
-            draw_item_attrs(str, line_idx, item_idx, start);
+            draw_item_attrs(str, line_idx, item_idx, start, attrs);
             wmove(window, line_idx, 0);
         }
 
+        /**
+         * Erase the rows from `row` to the bottom of the menu.
+        */
+        auto erase_rows(int row) -> void {
+            int y, x;
+            getyx(window, y, x);
+            for (; row < (last_line - first_line); ++row) {
+                wmove(window, row, 0);
+                wclrtoeol(window);
+            }
+            wmove(window, y, x);
+        }
+
         /**
          * Draw `n_items` items starting from `start_idx`.  The
          * cursor is repositioned to the `cursor`th row, which
          * points to the `data_idx`th item.
         */
         auto show_items(int start_idx, int n_items, int cursor, int data_idx, bool info = false) -> void {
-            if (std::empty(items)) {
+            if (get_size(data) == 0) {
                 return;
             }
             for (int j = start_idx; j < (start_idx + n_items); ++j) {
@@ -700,53 +1504,117 @@ class Menu {
         int first_line;
         int last_line;
         WINDOW* window;
-        vec<Item> items;
-        vec2d<ItemAttr> item_attrs;
-        std::set<int> selected_items;
+        MenuData data;
+        vec<std::pair<std::shared_ptr<const Lines>, Selection>> selections;
         int n_lines;
         int n_cols;
         Scroller scroller;
         bool show_info;
+        int version;
 };
 
 /**
  * Get all selected items.
  *
+ * Items stay selected when switching to other menus that show them
+ * (eg. search results of the same input).
+ *
  * @return selected items.
  */
 auto get_selections(const Menu& m) -> vec<str> {
-    auto selections = newVecReserve<str>(len(m.selected_items));
-    for (const auto& item_idx : m.selected_items) {
-        append(selections, *get_text(m.items[item_idx]));
+    auto selections = vec<str>();
+    for (const auto& [items, selected] : m.selections) {
+        forall_selected(selected, [&](const int item_idx) {
+                append(selections, str(get_text(*items, item_idx)));
+                });
     }
     return selections;
 }
 
+/**
+ * Write all selected items to `fd`, one per line.
+ *
+ * Items are copied to a large buffer that is written with one `write`
+ * call when full, so writing millions of items takes a few system
+ * calls.
+ *
+ * @return false if writing failed.
+ */
+auto write_selections(const Menu& m, int fd) -> bool {
+    auto buf = vec<char>();
+    buf.reserve(1 << 16);
+    auto flush = [&]() {
+        for (std::size_t n_written = 0; n_written < len(buf);) {
+            auto n = write(fd, buf.data() + n_written, len(buf) - n_written);
+            if ((n < 0) and (errno == EINTR)) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            n_written += n;
+        }
+        ::clear(buf);
+        return true;
+    };
+
+    bool ok = true;
+    for (const auto& [items, selected] : m.selections) {
+        forall_selected(selected, [&](const int item_idx) {
+                const auto text = get_text(*items, item_idx);
+                buf.insert(std::end(buf), std::begin(text), std::end(text));
+                buf.push_back('\n');
+                if (ok and (len(buf) >= (1 << 16))) {
+                    ok = flush();
+                }
+                });
+    }
+    return ok and flush();
+}
+
+/**
+ * Select (or unselect) all items shown, eg. all matches of a search.
+ *
+ * Items shown in order (ie, the input before any search) are selected
+ * a word at a time.
+ */
+auto select_all(Menu& m, bool selected) -> void {
+    if (get_size(m.data) == 0) {
+        return;
+    }
+    m.for_shown([selected](auto& selection, int beg, int end) { set_range(selection, beg, end, selected); });
+    m.redraw();
+}
+
+/**
+ * Invert the selection of the items shown.
+ */
+auto invert_selection(Menu& m) -> void {
+    if (get_size(m.data) == 0) {
+        return;
+    }
+    m.for_shown([](auto& selection, int beg, int end) { invert_range(selection, beg, end); });
+    m.redraw();
+}
+
 /**
 */
 auto toggle_info(Menu& m) -> void {
     m.show_info = not m.show_info;
     auto [c, db, di] = current(m.scroller);
-    m.show_items(db, std::min((int)len(m.items) - db, m.n_lines), c, di, m.show_info);
+    m.show_items(db, std::min(get_size(m.data) - db, m.n_lines), c, di, m.show_info);
 }
 
 /**
  * Select the current line.
  */
 auto toggle_selection(Menu& m) -> void {
-    if (std::empty(m.items)) {
+    if (get_size(m.data) == 0) {
         return;
     }
 
     auto [c, db, di] = current(m.scroller);
-    if (isin(m.selected_items, di)) {
-        remove(m.selected_items, di);
-        set_selected(m.items[di], false);
-    }
-    else {
-        insert(m.selected_items, di);
-        set_selected(m.items[di], true);
-    }
+    toggle(m.get_selected(), get_index(m.data, di));
     m.show_item(di, c, m.show_info);
     m.highlight(c, di);
 }
@@ -757,7 +1625,7 @@ auto toggle_selection(Menu& m) -> void {
  * @param line the line to select.
  */
 auto toggle_selection(Menu& m, int line) -> void {
-    if (std::empty(m.items)) {
+    if (get_size(m.data) == 0) {
         return;
     }
     auto [c, db, di] = current(m.scroller);
@@ -774,29 +1642,56 @@ auto toggle_selection(Menu& m, int line) -> void {
  * (`ItemAttr`s) that are applied to different substrings
  * of the string.
  *
- * @param results strings to show as menu items.
- * @param attr per-string ncurses attributes to apply
- *      to regions of each string.
+ * The items are not copied, so this takes constant time
+ * regardless of how many items there are.
+ *
+ * @param data items to show and their attributes.
+ */
+auto setall(Menu& m, const MenuData& data) -> void {
+    m.data = data;
+
+    auto items_len = get_size(data);
+    m.n_lines = std::min(m.last_line - m.first_line, items_len);
+    // Rows are overwritten rather than cleared first, so that ncurses
+    // only sends the cells that changed to the terminal.
+    m.show_items(0, std::min(items_len, m.n_lines), 0, 0, m.show_info);
+    m.erase_rows(m.n_lines);
+    m.scroller = Scroller(m.n_lines, items_len);
+    ++m.version;
+}
+
+/**
+ * Show more of the items that the menu views.
+ *
+ * The menu needs to show the first items of its items in order (see
+ * `MenuData`), and `size` more of them are shown.  The cursor stays
+ * where it is, and the screen is only redrawn if some of the new
+ * items are visible.
+ *
+ * @param size new number of items to show.
  */
-auto setall(Menu& m, cvec<Item>& items, cvec2d<ItemAttr>& attrs) -> void {
-    if (std::empty(items)) {
+auto extend(Menu& m, int size) -> void {
+    auto old_len = get_size(m.data);
+    if (size <= old_len) {
         return;
     }
 
-    clear(m.items);
-    clear(m.item_attrs);
-    mapall(items, m.items, identity<Item>);
-    if (len(attrs) == len(items)) {
-        mapall(attrs, m.item_attrs, identity<vec<ItemAttr>>);
+    extend(m.data, size);
+    m.n_lines = std::min(m.last_line - m.first_line, size);
+    resize(m.scroller, m.n_lines, size);
+    if (auto [c, db, di] = current(m.scroller); old_len < (db + m.n_lines)) {
+        m.show_items(db, std::min(size - db, m.n_lines), c, di, m.show_info);
     }
-
-    auto items_len = len(items);
-    m.n_lines = std::min(m.last_line - m.first_line, (int)items_len);
-    wclear(m.window);
-    m.show_items(0, std::min((int)items_len, m.n_lines), 0, 0, m.show_info);
-    m.scroller = Scroller(m.n_lines, items_len);
 }
 
+/**
+ * Get the number of times the menu contents were replaced.
+ *
+ * This is used to tell whether the menu still shows the items it was
+ * last extended with.
+ */
+auto get_version(const Menu& m) -> int { return m.version; }
+
 /**
  * Resize menu.
  *
@@ -808,26 +1703,26 @@ auto resize(Menu& m, const std::tuple<int, int, int>& bounds) -> void {
     m.last_line = std::get<1>(bounds);
     m.n_cols = std::get<2>(bounds);
 
-    auto items_len = len(m.items);
-    m.n_lines = std::min(m.last_line - m.first_line, (int)items_len);
+    auto items_len = get_size(m.data);
+    m.n_lines = std::min(m.last_line - m.first_line, items_len);
     auto [c, db, di] = current(m.scroller);
-    m.show_items(db, std::min((int)items_len - db, m.n_lines), 0, db, m.show_info);
+    m.show_items(db, std::min(items_len - db, m.n_lines), 0, db, m.show_info);
     m.scroller = Scroller(m.n_lines, items_len, db);
 }
 
 /**
 */
-auto getall(const Menu& m) -> cvec<Item>* { return &m.items; }
+auto getall(const Menu& m) -> const MenuData* { return &m.data; }
 
 /**
  * Scroll to the next item.
  */
 auto next(Menu& m) -> void {
-    if (std::empty(m.items)) {
+    if (get_size(m.data) == 0) {
         return;
     }
     if (auto [c, db, di] = next(m.scroller); scrolled(m.scroller)) {
-        m.show_items(db, std::min((int)len(m.items), m.n_lines), c, di, m.show_info);
+        m.show_items(db, std::min(get_size(m.data), m.n_lines), c, di, m.show_info);
     }
     else {
         m.unhighlight(c - 1, di - 1);
@@ -840,20 +1735,20 @@ auto next(Menu& m) -> void {
  *
  * @return selected items.
  */
-auto current(const Menu& m) -> cstr* {
-    if (std::empty(m.items)) return nullptr;
+auto current(const Menu& m) -> std::optional<std::string_view> {
+    if (get_size(m.data) == 0) return std::nullopt;
     auto [c, db, di] = current(m.scroller);
-    return get_text(m.items[di]);
+    return get_text(m.data, di);
 }
 
 /**
 */
 auto prev(Menu& m) -> void {
-    if (std::empty(m.items)) {
+    if (get_size(m.data) == 0) {
         return;
     }
     if (auto [c, db, di] = prev(m.scroller); scrolled(m.scroller)) {
-        m.show_items(di, std::min((int)len(m.items) - di, m.n_lines), c, di, m.show_info);
+        m.show_items(di, std::min(get_size(m.data) - di, m.n_lines), c, di, m.show_info);
     }
     else {
         m.unhighlight(c + 1, di + 1);
@@ -876,6 +1771,7 @@ class CommandLine {
     friend auto set_text(CommandLine& c, cstr& text) -> void;
     friend auto get_mode(const CommandLine& c) -> char;
     friend auto set_mode(CommandLine& c, char ch) -> void;
+    friend auto set_info(CommandLine& c, cstr& info) -> void;
 
     public:
 
@@ -890,8 +1786,8 @@ class CommandLine {
          * @param bounds bounds of the menu given as
          *      `(row, num of columns)`.
         */
-        CommandLine(WINDOW* window, const std::tuple<int, int>& bounds) : window(window), text(), status_info("[ ]:"), row(std::get<0>(bounds)), n_cols(std::get<1>(bounds)) {
-            scroller = Scroller(n_cols - len(status_info), 0);
+        CommandLine(WINDOW* window, const std::tuple<int, int>& bounds) : window(window), text(), status_info("[ ]:"), info(), row(std::get<0>(bounds)), n_cols(std::get<1>(bounds)) {
+            scroller = Scroller(get_text_width(), 0);
         }
 
 
@@ -903,11 +1799,14 @@ class CommandLine {
         auto redraw() -> void {
             auto [c, db, di] = current(scroller);
             auto status_len = len(status_info);
-            auto text_len = status_len > n_cols ? 0 : n_cols - status_len;
+            auto text_len = std::max(get_text_width(), 0);
             wmove(window, row, 0);
             wclrtoeol(window);
             mvwaddnstr(window, row, 0, status_info.c_str(), n_cols);
             mvwaddnstr(window, row, status_len, text.c_str() + db, text_len);
+            if ((status_len + len(info)) < n_cols) {
+                mvwaddnstr(window, row, n_cols - len(info), info.c_str(), len(info));
+            }
             wmove(window, row, std::min(c + (int)status_len, n_cols));
 
             //wmove(window, row - 1, 0);
@@ -915,9 +1814,17 @@ class CommandLine {
             //mvwaddnstr(window, row - 1, 0, (text).c_str() + db, n_cols);
         }
 
+        /**
+         * Get the number of columns available to the text.
+        */
+        auto get_text_width() const -> int {
+            return n_cols - (int)len(status_info) - (int)len(info);
+        }
+
         WINDOW *window;
         str text;
         str status_info;
+        str info;
         int row;
         int n_cols;
         Scroller scroller;
@@ -947,6 +1854,17 @@ auto set_mode(CommandLine& c, char ch) -> void {
  */
 auto get_text(const CommandLine& c) -> str { return c.text; }
 
+/**
+ * Set the status information shown at the end of the command line.
+ *
+ * @param info text to show (eg. the number of lines read).
+ */
+auto set_info(CommandLine& c, cstr& info) -> void {
+    c.info = info;
+    resize(c.scroller, c.get_text_width(), len(c.text) + 1);
+    c.redraw();
+}
+
 /**
  * Return the command line text.
  *
@@ -954,7 +1872,7 @@ auto get_text(const CommandLine& c) -> str { return c.text; }
  */
 auto set_text(CommandLine& c, cstr& text) -> void {
     c.text = text;
-    c.scroller = Scroller(c.n_cols - len(c.status_info), len(c.text) + 1);
+    c.scroller = Scroller(c.get_text_width(), len(c.text) + 1);
     c.redraw();
 }
 
@@ -968,7 +1886,7 @@ auto resize(CommandLine& c, const std::tuple<int, int>& bounds) -> void {
     c.row = std::get<0>(bounds);
     c.n_cols = std::get<1>(bounds);
     auto [cu, db, di] = current(c.scroller);
-    c.scroller = Scroller(c.n_cols - len(c.status_info), len(c.text) + 1, db);
+    c.scroller = Scroller(c.get_text_width(), len(c.text) + 1, db);
     c.redraw();
 }
 
@@ -976,7 +1894,7 @@ auto resize(CommandLine& c, const std::tuple<int, int>& bounds) -> void {
 */
 auto clear(CommandLine& c) -> void {
     ::clear(c.text);
-    c.scroller = Scroller(c.n_cols - len(c.status_info), 0);
+    c.scroller = Scroller(c.get_text_width(), 0);
     c.redraw();
 }
 
@@ -1113,6 +2031,531 @@ auto add_go_next(History<T>& h, T present) -> void {
 template<typename T>
 auto getall(const History<T>& h) -> cvec<T>* { return &h.history; }
 
+/**
+ * Lines read from a file descriptor (usually stdin) on a background
+ * thread.
+ *
+ * The input is read in blocks as it arrives.  The lines read so far
+ * are collected with `take`, so the menu can be shown and searched
+ * before all of the input is read.
+*/
+class InputReader {
+    friend auto take(InputReader& r, Lines& lines) -> bool;
+
+    public:
+        /**
+         * Constructor.
+         *
+         * @param fd file descriptor to read.  It is closed by the
+         *      reader.
+         * @param delim byte that ends lines.
+        */
+        explicit InputReader(int fd, char delim = '\n') : fd(fd), delim(delim), stop_fd(eventfd(0, EFD_CLOEXEC)), pending(), done(false) {
+            reader = std::thread([this]() { run(); });
+        }
+
+        ~InputReader() {
+            eventfd_write(stop_fd, 1);
+            reader.join();
+            ::close(stop_fd);
+            ::close(fd);
+        }
+
+        InputReader(const InputReader&) = delete;
+        auto operator=(const InputReader&) -> InputReader& = delete;
+
+    private:
+
+        /**
+         * Read lines until the end of the input, or until the reader
+         * is destroyed.
+        */
+        auto run() -> void {
+            auto block_reader = linestore::BlockReader(fd, delim);
+            auto fds = std::array<pollfd, 2>{
+                pollfd{.fd=fd, .events=POLLIN, .revents=0},
+                pollfd{.fd=stop_fd, .events=POLLIN, .revents=0},
+            };
+            for (bool more = true; more;) {
+                if (poll(fds.data(), len(fds), -1) < 0) {
+                    if (errno == EINTR) continue;
+                    break;
+                }
+                if (fds[1].revents != 0) {
+                    break;
+                }
+
+                more = block_reader.read_block();
+                auto lock = std::lock_guard(mutex);
+                for (auto line = std::string_view(); block_reader.next(line);) {
+                    pending.append(line.data(), len(line));
+                }
+            }
+
+            auto lock = std::lock_guard(mutex);
+            done = true;
+        }
+
+        int fd;
+        char delim;
+        int stop_fd;
+        std::mutex mutex;
+        linestore::LineStore pending;
+        bool done;
+        std::thread reader;
+};
+
+/**
+ * Add the lines read since the last call to `lines`.
+ *
+ * The lines read are swapped out under the lock, and only copied
+ * once it is released, so the reader isn't held up by the copy.
+ *
+ * @return true if all of the input has been read.
+ */
+auto take(InputReader& r, Lines& lines) -> bool {
+    auto pending = linestore::LineStore();
+    bool done;
+    {
+        auto lock = std::lock_guard(r.mutex);
+        std::swap(pending, r.pending);
+        done = r.done;
+    }
+    add_texts(lines, pending);
+    return done;
+}
+
+/**
+ * Compressed stores of files (see `fmindex::Index`), which take about
+ * as much memory as the files compressed, instead of their lines.
+ *
+ * A file is loaded by the first search that needs it, and isn't read
+ * again.
+ *
+ * * mutex: held while files are loaded.
+ * * indexes: the store of each file loaded.
+ * * n_threads: number of threads to load each file with (see
+ *   `fmindex::load_file`).
+*/
+class CompressedFiles {
+    friend auto get_compressed(CompressedFiles& cf, cvec<str>& filenames) -> CompressedData;
+
+    public:
+        explicit CompressedFiles(unsigned int n_threads = 1) : mutex(), indexes(), n_threads(n_threads) {}
+
+    private:
+        std::mutex mutex;
+        map<str, std::shared_ptr<const fmindex::Index>> indexes;
+        unsigned int n_threads;
+};
+
+/**
+ * Get the compressed stores of files, loading the ones not loaded yet.
+ *
+ * @return the store of each file, in the same order as `filenames`
+ *      (an empty store for the files that can't be read).
+ */
+auto get_compressed(CompressedFiles& cf, cvec<str>& filenames) -> CompressedData {
+    auto lock = std::lock_guard(cf.mutex);
+    auto data = CompressedData();
+    data.reserve(len(filenames));
+    for (cstr& filename : filenames) {
+        auto [it, inserted] = cf.indexes.try_emplace(filename);
+        if (inserted) {
+            auto index = std::make_shared<fmindex::Index>();
+            if (not fmindex::load_file(filename, *index, cf.n_threads)) {
+                *index = fmindex::Index();
+            }
+            it->second = std::move(index);
+        }
+        append(data, it->second);
+    }
+    return data;
+}
+
+/**
+ * Maximum number of bytes of results kept by a `ResultStack`.
+*/
+constexpr std::size_t max_result_stack_bytes = 1 << 24;
+
+/**
+ * Results of the queries typed so far while editing a `/` query.
+ *
+ * Each entry is a query and its results, and each query is a prefix
+ * of the next, so that deleting characters from the end of the query
+ * finds the results of the shorter query without searching again.
+ * `/` searches always look in the same items until the query is left
+ * (see `get_search_base`), so the results stay valid until then.
+ *
+ * The oldest results are dropped to stay within
+ * `max_result_stack_bytes` (see `get_n_bytes`).
+*/
+class ResultStack {
+    friend auto push_results(ResultStack& rs, cstr& query, const MenuData& results) -> void;
+    friend auto pop_results(ResultStack& rs, cstr& query) -> const MenuData*;
+    friend auto clear_results(ResultStack& rs) -> void;
+
+    public:
+        ResultStack() : entries(), n_bytes(0) {}
+
+    private:
+
+        /**
+         * @return the number of bytes that the results of an entry use.
+        */
+        static auto get_entry_bytes(const std::pair<str, MenuData>& entry) -> std::size_t {
+            return len(entry.first) + get_n_bytes(entry.second);
+        }
+
+        std::deque<std::pair<str, MenuData>> entries;
+        std::size_t n_bytes;
+};
+
+/**
+ * Add the results of `query`.
+ *
+ * Entries for queries that aren't prefixes of `query` (ie. that were
+ * edited away) are dropped first.
+ */
+auto push_results(ResultStack& rs, cstr& query, const MenuData& results) -> void {
+    while ((not std::empty(rs.entries)) and
+            ((len(rs.entries.back().first) >= len(query)) or (not query.starts_with(rs.entries.back().first)))) {
+        rs.n_bytes -= ResultStack::get_entry_bytes(rs.entries.back());
+        rs.entries.pop_back();
+    }
+    rs.entries.emplace_back(query, results);
+    rs.n_bytes += ResultStack::get_entry_bytes(rs.entries.back());
+    while ((rs.n_bytes > max_result_stack_bytes) and (len(rs.entries) > 1)) {
+        rs.n_bytes -= ResultStack::get_entry_bytes(rs.entries.front());
+        rs.entries.pop_front();
+    }
+}
+
+/**
+ * Get the results of `query` after characters were deleted from it.
+ *
+ * Entries for longer queries are dropped.
+ *
+ * @return the results, or nullptr if they aren't known.
+ */
+auto pop_results(ResultStack& rs, cstr& query) -> const MenuData* {
+    while ((not std::empty(rs.entries)) and
+            ((len(rs.entries.back().first) > len(query)) or (not query.starts_with(rs.entries.back().first)))) {
+        rs.n_bytes -= ResultStack::get_entry_bytes(rs.entries.back());
+        rs.entries.pop_back();
+    }
+    if (std::empty(rs.entries) or (rs.entries.back().first != query)) {
+        return nullptr;
+    }
+    return &rs.entries.back().second;
+}
+
+/**
+ * Drop all results.
+ */
+auto clear_results(ResultStack& rs) -> void {
+    rs.entries.clear();
+    rs.n_bytes = 0;
+}
+
+/**
+ * Maximum number of bytes of results kept by a `ResultCache`.
+*/
+constexpr std::size_t max_result_cache_bytes = 1 << 26;
+
+/**
+ * What the results of a search depend on.
+ *
+ *   mode: `/` or `?`.
+ *   query: the command line text (see `make_result_key`).
+ *   corpus: generation of the items searched (see `get_generation`),
+ *          or 0 for the files given on the command line.
+ *   corpus_size: number of items searched.
+ *   files: `(size, mtime)` of the files given on the command line
+ *          that are searched, as cached when the search was started
+ *          (nothing for files not cached yet).  Files read again
+ *          after being edited get a new key, so their old results
+ *          aren't reused.
+*/
+struct ResultKey {
+    char mode;
+    str query;
+    std::uint64_t corpus;
+    int corpus_size;
+    FileKeys files;
+};
+
+/**
+ * Make the key of a search.
+ *
+ * Leading and trailing spaces don't change subsequence queries, so
+ * they are dropped, unless the query has a quoted phrase in which
+ * they might count.
+ */
+auto make_result_key(char mode, cstr& text, const std::optional<MenuData>& corpus, FileKeys&& files = {}) -> ResultKey {
+    auto query = text;
+    bool regex = (not std::empty(text)) and (text[0] == '/');
+    if ((not regex) and (query.find('"') == str::npos)) {
+        query.erase(0, std::min(query.find_first_not_of(' '), len(query)));
+        query.erase(query.find_last_not_of(' ') + 1);
+    }
+    return ResultKey{.mode=mode, .query=std::move(query), .corpus=corpus ? get_generation(*corpus) : 0,
+        .corpus_size=corpus ? get_size(*corpus) : 0, .files=std::move(files)};
+}
+
+/**
+ * Tell whether two keys are for the same search.
+ *
+ * Files that weren't cached have unknown contents, so keys with them
+ * are never the same.
+ */
+auto is_same(const ResultKey& a, const ResultKey& b) -> bool {
+    if ((a.mode != b.mode) or (a.query != b.query) or (a.corpus != b.corpus) or (a.corpus_size != b.corpus_size)) {
+        return false;
+    }
+    return (a.files == b.files) and std::ranges::all_of(a.files, [](const auto& file) { return file.has_value(); });
+}
+
+/**
+ * Results of recent searches, most recently used first.
+ *
+ * Going back to a query (eg. retyping it or picking it with `f`) shows
+ * its results without searching again.  Keys only hold numbers, so
+ * they don't keep corpora or files alive, and a view being freed and
+ * another taking its place can't be mistaken for the same corpus since
+ * they have different generations.  The input read from stdin only
+ * grows, so when more of it has been read, results over less of it are
+ * dropped.
+ *
+ * The least recently used results are dropped to stay within
+ * `max_result_cache_bytes` (see `get_n_bytes`), counting the text that
+ * results copied.  The highlighters of the results (ie. the compiled
+ * queries) are kept with them.
+*/
+class ResultCache {
+    friend auto find_results(ResultCache& rc, const ResultKey& key) -> const MenuData*;
+    friend auto add_results(ResultCache& rc, const ResultKey& key, const MenuData& results) -> void;
+
+    public:
+        ResultCache() : entries(), n_bytes(0) {}
+
+    private:
+
+        /**
+         * @return the number of bytes that the results of an entry use.
+        */
+        static auto get_entry_bytes(const std::pair<ResultKey, MenuData>& entry) -> std::size_t {
+            const auto& key = entry.first;
+            return len(key.query) + len(key.files) * sizeof(FileKeys::value_type) + get_n_bytes(entry.second);
+        }
+
+        std::list<std::pair<ResultKey, MenuData>> entries;
+        std::size_t n_bytes;
+};
+
+/**
+ * Get the results of a search, and mark them as the most recently
+ * used.
+ *
+ * @return the results, or nullptr if they aren't known.
+ */
+auto find_results(ResultCache& rc, const ResultKey& key) -> const MenuData* {
+    auto it = std::ranges::find_if(rc.entries, [&](const auto& e) { return is_same(e.first, key); });
+    if (it == std::end(rc.entries)) {
+        return nullptr;
+    }
+    rc.entries.splice(std::begin(rc.entries), rc.entries, it);
+    return &rc.entries.front().second;
+}
+
+/**
+ * Add the results of a search.
+ */
+auto add_results(ResultCache& rc, const ResultKey& key, const MenuData& results) -> void {
+    std::erase_if(rc.entries, [&](const auto& e) {
+            const auto& other = e.first;
+            bool is_stale = is_same(other, key) or (
+                    (key.corpus != 0) and (other.corpus == key.corpus) and (other.corpus_size < key.corpus_size));
+            if (is_stale) {
+                rc.n_bytes -= ResultCache::get_entry_bytes(e);
+            }
+            return is_stale;
+            });
+
+    rc.entries.emplace_front(key, results);
+    rc.n_bytes += ResultCache::get_entry_bytes(rc.entries.front());
+    while ((rc.n_bytes > max_result_cache_bytes) and (len(rc.entries) > 1)) {
+        rc.n_bytes -= ResultCache::get_entry_bytes(rc.entries.back());
+        rc.entries.pop_back();
+    }
+}
+
+/**
+ * A result of a search run by a `SearchWorker`.
+ *
+ *   id: id of the search (see `submit`).
+ *   data: the matches.
+ *   done: false for the provisional results of a search that is still
+ *          running.
+*/
+struct SearchResult {
+    int id;
+    MenuData data;
+    bool done;
+};
+
+/**
+ * Runs searches on a background thread.
+ *
+ * Only the last search submitted is run: a search submitted while
+ * another is waiting replaces it, and one that is running is
+ * cancelled.  Searches are given a flag that is set when they are
+ * cancelled, which they should check every `lz::cancel_interval`
+ * items or so and then return early; their results are dropped.
+ *
+ * When a search finishes or reports provisional results, the result
+ * is kept until it is taken with `take` (replacing any result not
+ * taken yet), and the eventfd from `get_fd` becomes readable, so the
+ * UI can wait for results along with keys.
+*/
+class SearchWorker {
+    friend auto submit(SearchWorker& w, SearchFn&& search) -> int;
+    friend auto take(SearchWorker& w) -> std::optional<SearchResult>;
+    friend auto get_fd(const SearchWorker& w) -> int;
+    friend auto is_busy(SearchWorker& w) -> bool;
+    friend auto cancel(SearchWorker& w) -> void;
+
+    public:
+        SearchWorker() : done_fd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)), pending(), pending_id(0), cancel(), running(false), result(), quit(false) {
+            worker = std::thread([this]() { run(); });
+        }
+
+        ~SearchWorker() {
+            {
+                auto lock = std::lock_guard(mutex);
+                quit = true;
+                if (cancel != nullptr) {
+                    *cancel = true;
+                }
+            }
+            cv.notify_one();
+            worker.join();
+            ::close(done_fd);
+        }
+
+        SearchWorker(const SearchWorker&) = delete;
+        auto operator=(const SearchWorker&) -> SearchWorker& = delete;
+
+    private:
+
+        /**
+         * Run searches as they are submitted, until the worker is
+         * destroyed.
+        */
+        auto run() -> void {
+            auto lock = std::unique_lock(mutex);
+            while (true) {
+                cv.wait(lock, [this]() { return quit or (pending != nullptr); });
+                if (quit) {
+                    break;
+                }
+
+                auto search = std::move(pending);
+                pending = nullptr;
+                int id = pending_id;
+                auto cancelled = cancel;
+                running = true;
+                lock.unlock();
+                auto progress = [this, id, cancelled](MenuData&& md) {
+                    auto progress_lock = std::lock_guard(mutex);
+                    if (not *cancelled) {
+                        result = SearchResult{.id=id, .data=std::move(md), .done=false};
+                        eventfd_write(done_fd, 1);
+                    }
+                };
+                auto md = search(*cancelled, progress);
+                lock.lock();
+                running = false;
+
+                if (not *cancelled) {
+                    result = SearchResult{.id=id, .data=std::move(md), .done=true};
+                    eventfd_write(done_fd, 1);
+                }
+            }
+        }
+
+        int done_fd;
+        std::mutex mutex;
+        std::condition_variable cv;
+        SearchFn pending;
+        int pending_id;
+        std::shared_ptr<std::atomic<bool>> cancel;
+        bool running;
+        std::optional<SearchResult> result;
+        bool quit;
+        std::thread worker;
+};
+
+/**
+ * Submit a search, cancelling the one before it.
+ *
+ * @return id of the search, to tell its result apart (see `take`).
+ */
+auto submit(SearchWorker& w, SearchFn&& search) -> int {
+    int id;
+    {
+        auto lock = std::lock_guard(w.mutex);
+        if (w.cancel != nullptr) {
+            *w.cancel = true;
+        }
+        w.cancel = std::make_shared<std::atomic<bool>>(false);
+        w.pending = std::move(search);
+        id = ++w.pending_id;
+    }
+    w.cv.notify_one();
+    return id;
+}
+
+/**
+ * Take the latest result of the searches.
+ *
+ * @return the result, or nothing if there was none since the last
+ *      call.
+ */
+auto take(SearchWorker& w) -> std::optional<SearchResult> {
+    eventfd_t count;
+    eventfd_read(w.done_fd, &count);
+    auto lock = std::lock_guard(w.mutex);
+    return std::exchange(w.result, std::nullopt);
+}
+
+/**
+ * Get an eventfd that is readable when a search has finished.
+ */
+auto get_fd(const SearchWorker& w) -> int { return w.done_fd; }
+
+/**
+ * Tell whether a search is waiting or running.
+ *
+ * Searches read the items they search without locking, so items must
+ * not change while this is true.
+ */
+auto is_busy(SearchWorker& w) -> bool {
+    auto lock = std::lock_guard(w.mutex);
+    return w.running or (w.pending != nullptr);
+}
+
+/**
+ * Cancel the search that is waiting or running, if any.
+ */
+auto cancel(SearchWorker& w) -> void {
+    auto lock = std::lock_guard(w.mutex);
+    if (w.cancel != nullptr) {
+        *w.cancel = true;
+    }
+    w.pending = nullptr;
+}
+
 /**
  * An interactive menu.
 */
@@ -1120,22 +2563,43 @@ class Mew {
     friend auto next_menu(Mew& m) -> const MenuHistoryElem*;
     friend auto prev_menu(Mew& m) -> const MenuHistoryElem*;
     friend auto insert_menu(Mew& m, MenuHistoryElem&& e) -> void;
-    friend auto next_cmd(Mew& m) -> const Item*;
-    friend auto prev_cmd(Mew& m) -> const Item*;
-    friend auto insert_cmd(Mew& m, Item&& c) -> void;
-    friend auto getall_cmd(const Mew& m) -> cvec<Item>*;
-    friend auto next_qry(Mew& m) -> const Item*;
-    friend auto prev_qry(Mew& m) -> const Item*;
-    friend auto insert_qry(Mew& m, Item&& q) -> void;
-    friend auto getall_qry(const Mew& m) -> cvec<Item>*;
-    friend auto get_initdata(const Mew& m) -> cvec<Item>*;
+    friend auto next_cmd(Mew& m) -> const str*;
+    friend auto prev_cmd(Mew& m) -> const str*;
+    friend auto insert_cmd(Mew& m, str&& c) -> void;
+    friend auto getall_cmd(const Mew& m) -> cvec<str>*;
+    friend auto next_qry(Mew& m) -> const str*;
+    friend auto prev_qry(Mew& m) -> const str*;
+    friend auto insert_qry(Mew& m, str&& q) -> void;
+    friend auto getall_qry(const Mew& m) -> cvec<str>*;
+    friend auto get_initdata(const Mew& m) -> MenuData;
     friend auto get_initfiles(const Mew& m) -> cvec<str>*;
+    friend auto get_initfiledata(Mew& m) -> FileData;
+    friend auto refresh_initfiles(Mew& m) -> void;
+    friend auto get_initcompressed(Mew& m) -> std::optional<CompressedData>;
+    friend auto find_initfilekeys(const Mew& m) -> FileKeys;
     friend auto get_selections(Mew& m) -> vec<str>;
+    friend auto write_selections(Mew& m, int fd) -> bool;
     friend auto show(Mew& m, const MenuData* menu_data) -> void;
     friend auto stop(Mew& m) -> void;
     friend auto close(Mew& m) -> void;
     friend auto get_cmdline_bounds(const Mew& m) -> std::tuple<int, int>;
     friend auto get_menu_bounds(const Mew& m) -> std::tuple<int, int, int>;
+    friend auto update_input(Mew& m) -> void;
+    friend auto is_input_done(const Mew& m) -> bool;
+    friend auto index_input(Mew& m) -> void;
+    friend auto get_indexer(const Mew& m) -> const lineindex::Indexer*;
+    friend auto draw(Mew& m) -> int;
+    friend auto handle_key(Mew& m, int c) -> void;
+    friend auto start_search(Mew& m, SearchFn&& search, cstr& text, ResultKey&& key, long n_items) -> void;
+    friend auto show_cached_results(Mew& m, cstr& text, const ResultKey& key) -> bool;
+    friend auto finish_search(Mew& m) -> void;
+    friend auto show_results(Mew& m, const MenuData& md, bool done) -> void;
+    friend auto get_search_delay(const Mew& m, long n_items) -> std::optional<std::chrono::steady_clock::duration>;
+    friend auto schedule_search(Mew& m, long n_items) -> void;
+    friend auto run_scheduled_search(Mew& m) -> int;
+    friend auto get_search_base(Mew& m, const Menu& menu) -> const MenuData&;
+    friend auto clear_search_base(Mew& m) -> void;
+    friend auto restore_results(Mew& m) -> void;
 
     public:
 
@@ -1145,8 +2609,21 @@ class Mew {
          * @param cmd function to execute when pressing `enter`.
          *      This takes the text from the command line as input
          *      and returns a list of strings and attributes.
+         * @param compressed_files compressed stores to search the files
+         *      given on the command line with, or nullptr to search
+         *      their lines.
+         * @param indexer builds the indexes of the input and files
+         *      that searches use, or nullptr to always search all of
+         *      the lines.
+         * @param input reader that `global_data` is filled from, or
+         *      nullptr if there is nothing left to read.
+         * @param incremental_thresh number of items below which `/`
+         *      searches are run as the query is typed, or -1 to decide
+         *      from the speed of searches (see `get_search_delay`).
+         * @param latency_budget time that searches may take to be run
+         *      as the query is typed.
         */
-        Mew(map<int, KeyCommand>&& user_keymap, map<int, int>&& remap, cvec<Item>* global_data,  cvec<str>* global_filenames, int incremental_thresh=500000, int incremental_file=false, bool parallel = false) : selected_strings(), menu(), cmdline(), quit(false) {
+        Mew(map<int, KeyCommand>&& user_keymap, map<int, int>&& remap, std::shared_ptr<Lines> global_data,  cvec<str>* global_filenames, filecache::FileCache* file_cache, CompressedFiles* compressed_files, lineindex::Indexer* indexer, InputReader* input, int incremental_thresh=-1, int incremental_file=false, bool parallel = false, std::chrono::milliseconds latency_budget = default_latency_budget) : selected_strings(), menu(), cmdline(), quit(false), input_win(nullptr), next_frame(), dirty(true), input_version(0), search_worker(), search_id(0), search_version(0), search_text(), search_base(), search_start(), search_latency(0), search_due(), search_size(0), search_rate(0), latency_budget(latency_budget), search_key(), result_stack(), result_cache() {
             this->user_keymap = user_keymap;
             this->remap = remap;
             this->parallel = parallel;
@@ -1154,6 +2631,10 @@ class Mew {
             this->incremental_file = incremental_file;
             this->global_data = global_data;
             this->global_filenames = global_filenames;
+            this->file_cache = file_cache;
+            this->compressed_files = compressed_files;
+            this->indexer = indexer;
+            this->input = input;
         }
 
     private:
@@ -1169,6 +2650,13 @@ class Mew {
             noecho();
             keypad(stdscr, TRUE);
             set_escdelay(0);
+            // Keys are read from a window that is never drawn on, so
+            // that reading them doesn't refresh the screen (see
+            // `draw`).
+            input_win = newwin(1, 1, 0, 0);
+            keypad(input_win, TRUE);
+            leaveok(input_win, TRUE);
+            untouchwin(input_win);
             init_pair(1, COLOR_RED, COLOR_BLACK);
             init_pair(2, COLOR_CYAN, COLOR_BLACK);
             // left | wheel up | wheel down.
@@ -1198,35 +2686,360 @@ class Mew {
         Menu menu;
         CommandLine cmdline;
         bool quit;
+        WINDOW *input_win;
+        std::chrono::steady_clock::time_point next_frame;
+        bool dirty;
         map<int, KeyCommand> keymap;
         int incremental_thresh;
         int incremental_file;
         History<MenuHistoryElem> menu_history;
-        History<Item> search_history;
-        History<Item> cmd_history;
+        History<str> search_history;
+        History<str> cmd_history;
         map<int, KeyCommand> user_keymap;
         map<int, int> remap;
         bool parallel;
-        cvec<Item>* global_data;
+        std::shared_ptr<Lines> global_data;
         cvec<str>* global_filenames;
+        filecache::FileCache* file_cache;
+        CompressedFiles* compressed_files;
+        lineindex::Indexer* indexer;
+        InputReader* input;
+        int input_version;
+        SearchWorker search_worker;
+        int search_id;
+        int search_version;
+        str search_text;
+        std::optional<MenuData> search_base;
+        std::chrono::steady_clock::time_point search_start;
+        std::chrono::steady_clock::duration search_latency;
+        std::optional<std::chrono::steady_clock::time_point> search_due;
+        long search_size;
+        double search_rate;
+        std::chrono::milliseconds latency_budget;
+        ResultKey search_key;
+        ResultStack result_stack;
+        ResultCache result_cache;
 };
 
 /**
- * Get bounds of the command line.
+ * Get bounds of the command line.
+ *
+ * @return bounds as `(row, num of columns)`.
+ */
+auto get_cmdline_bounds(const Mew& m) -> std::tuple<int, int> {
+    return {LINES - 1, COLS - 1};
+}
+
+/**
+ * Get bounds of the menu.
+ *
+ * @return bounds as `(first row, last row, num of columns)`.
+ */
+auto get_menu_bounds(const Mew& m) -> std::tuple<int, int, int> {
+    return {0, LINES - 2, COLS - 10};
+}
+
+/**
+ * Run the command of key `c`, or add `c` to the command line.
+ *
+ * In `/` mode (and `?` mode with `incremental_file`), the search is
+ * started again after each character (see `schedule_search`).
+ */
+auto handle_key(Mew& m, int c) -> void {
+    m.dirty = true;
+    bool handled = false;
+    if (isin(m.keymap, c)) {
+        handled = m.keymap[c](m, m.menu, m.cmdline);
+    }
+    if (m.quit) {
+        return;
+    }
+    if (not (handled or isin(cmd_modes, get_mode(m.cmdline)))) {
+        insert(m.cmdline, c);
+        if (get_mode(m.cmdline) == '/') {
+            schedule_search(m, get_size(get_search_base(m, m.menu)));
+        }
+        else if ((get_mode(m.cmdline) == '?') and (m.incremental_file)) {
+            schedule_search(m, -1);
+        }
+    }
+}
+
+/**
+ * Send the changes to the screen to the terminal, at most once per
+ * `frame_interval`.
+ *
+ * Drawing only changes the windows.  All changes since the last frame
+ * are sent at once with `wnoutrefresh` and `doupdate`, and ncurses
+ * only sends the cells that differ from what the terminal shows.  If
+ * keys come in faster than frames (eg. typing fast over ssh), they
+ * are all handled before the next frame, instead of sending one
+ * screen per key.
+ *
+ * @return how long to wait for keys (in ms, or -1 to wait until one
+ *      comes): until the pending frame is due, if any.
+ */
+auto draw(Mew& m) -> int {
+    auto now = std::chrono::steady_clock::now();
+    if (m.dirty and (now >= m.next_frame)) {
+        wnoutrefresh(stdscr);
+        doupdate();
+        m.dirty = false;
+        m.next_frame = now + frame_interval;
+    }
+
+    int timeout = (m.input != nullptr) ? 50 : -1;
+    if (m.dirty) {
+        auto until_frame = std::chrono::ceil<std::chrono::milliseconds>(m.next_frame - now).count();
+        timeout = (timeout < 0) ? int(until_frame) : std::min(timeout, int(until_frame));
+    }
+    return timeout;
+}
+
+/**
+ * Get the speed of a search.
+ *
+ * @return number of items searched per ms, or 0 if the search was too
+ *      short to tell.
+ */
+auto get_rate(long n_items, std::chrono::steady_clock::duration elapsed) -> double {
+    auto ms = std::chrono::duration<double, std::milli>(elapsed).count();
+    return ((n_items > 0) and (ms >= 1)) ? n_items / ms : 0;
+}
+
+/**
+ * Run a search on the search worker.
+ *
+ * The result is shown by `finish_search` when the search is done.
+ * Keys keep being handled in the meantime.
+ *
+ * @param search the search to run.  It must not use the menu or the
+ *      command line, which keep changing while it runs.
+ * @param text the command line text of the search.
+ * @param key key to cache the results with (see `ResultCache`).
+ * @param n_items number of items searched, or 0 if not known.  This
+ *      is used to measure the speed of searches.
+ */
+auto start_search(Mew& m, SearchFn&& search, cstr& text, ResultKey&& key, long n_items) -> void {
+    auto now = std::chrono::steady_clock::now();
+    // The search this one cancels took at least this long.
+    if (is_busy(m.search_worker)) {
+        m.search_latency = std::max(m.search_latency, now - m.search_start);
+        if (auto rate = get_rate(m.search_size, now - m.search_start); rate > 0) {
+            m.search_rate = (m.search_rate > 0) ? std::min(m.search_rate, rate) : rate;
+        }
+    }
+    m.search_id = submit(m.search_worker, std::move(search));
+    m.search_version = get_version(m.menu);
+    m.search_key = std::move(key);
+    m.search_text = text;
+    m.search_start = now;
+    m.search_size = n_items;
+    m.search_due = std::nullopt;
+}
+
+/**
+ * Get how long to wait for more keys before searching `n_items` items
+ * as a query is typed.
+ *
+ * Normally, searches wait for as long as recent searches took (up to
+ * `max_search_delay`).  So fast searches run right away, while slow
+ * ones aren't started for every key (eg. when pasting a query) only
+ * to be cancelled by the next one.
+ *
+ * How long the search will take is estimated from the speed of recent
+ * searches.  If it is over the latency budget, the search waits for
+ * `max_search_delay` instead, ie. for typing to pause.  If it is over
+ * `debounce_budgets` budgets, it isn't run until enter is pressed.
+ *
+ * With a fixed `incremental_thresh` (or until the speed of searches is
+ * known), searches over fewer items than it wait as usual, and others
+ * wait for enter.
+ *
+ * @param n_items number of items, or -1 if not known.  Searches over
+ *      an unknown number of items always wait as usual.
+ *
+ * @return the delay, or nothing if the search should wait for enter.
+ */
+auto get_search_delay(const Mew& m, long n_items) -> std::optional<std::chrono::steady_clock::duration> {
+    auto delay = std::min<std::chrono::steady_clock::duration>(m.search_latency, max_search_delay);
+    if (n_items < 0) {
+        return delay;
+    }
+    if ((m.incremental_thresh >= 0) or (m.search_rate <= 0)) {
+        auto thresh = (m.incremental_thresh >= 0) ? m.incremental_thresh : default_incremental_thresh;
+        return (n_items < thresh) ? std::optional(delay) : std::nullopt;
+    }
+
+    auto expected = std::chrono::duration<double, std::milli>(n_items / m.search_rate);
+    if (expected <= m.latency_budget) {
+        return delay;
+    }
+    if (expected <= debounce_budgets * m.latency_budget) {
+        return max_search_delay;
+    }
+    return std::nullopt;
+}
+
+/**
+ * Search for the command line text once keys stop coming.
+ *
+ * This is for searching as a query is typed, over `n_items` items.
+ * The search waits as long as `get_search_delay` says, and each key
+ * typed in the meantime starts the wait again.
+ */
+auto schedule_search(Mew& m, long n_items) -> void {
+    if (auto delay = get_search_delay(m, n_items); delay) {
+        m.search_due = std::chrono::steady_clock::now() + *delay;
+    }
+    else {
+        m.search_due = std::nullopt;
+    }
+}
+
+/**
+ * Start the search scheduled by `schedule_search`, if it is due.
+ *
+ * @return how long until it is due (in ms), or -1 if no search is
+ *      scheduled.
+ */
+auto run_scheduled_search(Mew& m) -> int {
+    if (not m.search_due) {
+        return -1;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (now < *m.search_due) {
+        return std::chrono::ceil<std::chrono::milliseconds>(*m.search_due - now).count();
+    }
+
+    m.search_due = std::nullopt;
+    if (auto mode = get_mode(m.cmdline); (mode == '/') or (mode == '?')) {
+        m.keymap[10](m, m.menu, m.cmdline);
+    }
+    return -1;
+}
+
+/**
+ * Get the items that `/` searches look in.
+ *
+ * These are the items the menu showed when the query started being
+ * typed, so that each key searches the same items no matter which
+ * earlier searches are done, until the query is left with escape.
+ */
+auto get_search_base(Mew& m, const Menu& menu) -> const MenuData& {
+    if (not m.search_base) {
+        m.search_base = *getall(menu);
+    }
+    return *m.search_base;
+}
+
+/**
+ * End the current query (see `get_search_base`).
+ *
+ * A search scheduled for it is not run, and the results kept while it
+ * was typed are dropped.
+ */
+auto clear_search_base(Mew& m) -> void {
+    m.search_base = std::nullopt;
+    m.search_due = std::nullopt;
+    clear_results(m.result_stack);
+}
+
+/**
+ * Show the results of the `/` query after characters were deleted
+ * from it.
+ *
+ * Results of the queries typed before are shown without searching
+ * again (see `ResultStack`), and so are the searched items once the
+ * query is empty.  Other queries are searched as if they were typed.
+ */
+auto restore_results(Mew& m) -> void {
+    const auto query = get_text(m.cmdline);
+    const auto* results = std::empty(query) ? &get_search_base(m, m.menu) : pop_results(m.result_stack, query);
+    if (results == nullptr) {
+        schedule_search(m, get_size(get_search_base(m, m.menu)));
+        return;
+    }
+
+    // Results of longer queries still to come are out of date.
+    cancel(m.search_worker);
+    m.search_due = std::nullopt;
+    setall(m.menu, *results);
+}
+
+/**
+ * Show results of the last search started.
  *
- * @return bounds as `(row, num of columns)`.
+ * Final results also go in the menu history.
  */
-auto get_cmdline_bounds(const Mew& m) -> std::tuple<int, int> {
-    return {LINES - 1, COLS - 1};
+auto show_results(Mew& m, const MenuData& md, bool done) -> void {
+    if (get_size(md) > 0) {
+        setall(m.menu, md);
+        if (done) {
+            insert_menu(m, MenuHistoryElem(md, m.search_text));
+            if (m.search_key.mode == '/') {
+                push_results(m.result_stack, m.search_text, md);
+            }
+        }
+        m.search_version = get_version(m.menu);
+    }
+    m.dirty = true;
 }
 
 /**
- * Get bounds of the menu.
+ * Show the latest result of the last search started.
  *
- * @return bounds as `(first row, last row, num of columns)`.
+ * Provisional results replace each other in the menu until the final
+ * results do, and only the final results go in the menu history.
+ * Results of searches that were replaced by newer ones are dropped,
+ * and so are results that come after the menu was changed (eg. by
+ * `H`), since the user moved on.
  */
-auto get_menu_bounds(const Mew& m) -> std::tuple<int, int, int> {
-    return {0, LINES - 2, COLS - 10};
+auto finish_search(Mew& m) -> void {
+    auto result = take(m.search_worker);
+    if ((not result) or (result->id != m.search_id)) {
+        return;
+    }
+    if (result->done) {
+        add_results(m.result_cache, m.search_key, result->data);
+
+        // Recent searches count the most, so that delays follow
+        // changes of the query and of the input (see `get_search_delay`).
+        auto elapsed = std::chrono::steady_clock::now() - m.search_start;
+        m.search_latency = (3 * m.search_latency + elapsed) / 4;
+        if (auto rate = get_rate(m.search_size, elapsed); rate > 0) {
+            m.search_rate = (m.search_rate > 0) ? (3 * m.search_rate + rate) / 4 : rate;
+        }
+    }
+    if (get_version(m.menu) != m.search_version) {
+        return;
+    }
+    show_results(m, result->data, result->done);
+}
+
+/**
+ * Show the cached results of a search instead of running it (see
+ * `ResultCache`).
+ *
+ * @param text the command line text of the search.
+ *
+ * @return false if the results aren't cached.
+ */
+auto show_cached_results(Mew& m, cstr& text, const ResultKey& key) -> bool {
+    const auto* results = find_results(m.result_cache, key);
+    if (results == nullptr) {
+        return false;
+    }
+
+    // Results of searches started before are out of date.  Ids of
+    // searches start at 1.
+    cancel(m.search_worker);
+    m.search_id = 0;
+    m.search_due = std::nullopt;
+    m.search_key = key;
+    m.search_text = text;
+    show_results(m, *results, true);
+    return true;
 }
 
 /**
@@ -1240,6 +3053,7 @@ auto stop(Mew& m) -> void {
  * End ncurses and stop showing contents.
  */
 auto close(Mew& m) -> void {
+    delwin(m.input_win);
     endwin();
 }
 
@@ -1252,34 +3066,113 @@ auto get_selections(Mew& m) -> vec<str> {
     return mew::get_selections(m.menu);
 }
 
+/**
+ * Write all selected items to `fd`, one per line.
+ */
+auto write_selections(Mew& m, int fd) -> bool {
+    return mew::write_selections(m.menu, fd);
+}
+
+/**
+ * Add the lines read from the input since the last call.
+ *
+ * The lines are appended to the menu as long as it still shows the
+ * input (ie, no search or command replaced it).  The number of lines
+ * read so far is shown in the command line, followed by `+` until
+ * all of the input is read.
+ */
+auto update_input(Mew& m) -> void {
+    // Lines are left with the reader while a search may be reading
+    // the items.
+    if ((m.input == nullptr) or is_busy(m.search_worker)) {
+        return;
+    }
+
+    auto n_items = get_size(*m.global_data);
+    bool done = take(*m.input, *m.global_data);
+    if ((get_size(*m.global_data) == n_items) and not done) {
+        return;
+    }
+
+    int y, x;
+    getyx(stdscr, y, x);
+    if (get_version(m.menu) == m.input_version) {
+        extend(m.menu, get_size(*m.global_data));
+    }
+    set_info(m.cmdline, std::to_string(get_size(*m.global_data)) + (done ? " " : "+"));
+    wmove(stdscr, y, x);
+
+    m.dirty = true;
+
+    if (done) {
+        m.input = nullptr;
+        index_input(m);
+    }
+}
+
+/**
+ * @return true if all of the input has been read (or there is none).
+ */
+auto is_input_done(const Mew& m) -> bool { return m.input == nullptr; }
+
+/**
+ * Index the input in the background once all of it is read, since
+ * it no longer changes.
+ */
+auto index_input(Mew& m) -> void {
+    if ((m.indexer != nullptr) and (m.input == nullptr)) {
+        m.indexer->add(std::shared_ptr<const linestore::LineStore>(m.global_data, &get_arena(*m.global_data)));
+    }
+}
+
+/**
+ * @return what builds the indexes for searches, or nullptr if there
+ *      is none.
+ */
+auto get_indexer(const Mew& m) -> const lineindex::Indexer* { return m.indexer; }
+
 /**
  * Draw contents on the screen.
  */
 auto show(Mew& m, const MenuData* menu_data = nullptr) -> void {
     m.init_screen();
     if (menu_data != nullptr) {
-        const auto& [results, attrs] = *menu_data;
-        setall(m.menu, results, attrs);
+        setall(m.menu, *menu_data);
     }
 
     set_mode(m.cmdline, 'i');
-    while (true) {
-        int c = wgetch(stdscr);
-        bool handled = false;
-        if (isin(m.keymap, c)) {
-            handled = m.keymap[c](m, m.menu, m.cmdline);
+
+    // Show the input as it is read, polling for more while waiting
+    // for keys.
+    if (m.input != nullptr) {
+        setall(m.menu, get_initdata(m));
+        m.input_version = get_version(m.menu);
+        update_input(m);
+    }
+
+    // Wait for keys and for searches to finish.  Keys are then read
+    // without blocking until there are none left, and all of them are
+    // handled before the screen is updated.
+    wtimeout(m.input_win, 0);
+    auto fds = std::array<pollfd, 2>{
+        pollfd{.fd=STDIN_FILENO, .events=POLLIN, .revents=0},
+        pollfd{.fd=get_fd(m.search_worker), .events=POLLIN, .revents=0},
+    };
+    while (not m.quit) {
+        auto timeout = draw(m);
+        if (auto until_search = run_scheduled_search(m); until_search >= 0) {
+            timeout = (timeout < 0) ? until_search : std::min(timeout, until_search);
         }
-        if (m.quit) {
+        if ((poll(fds.data(), len(fds), timeout) < 0) and (errno != EINTR)) {
             break;
         }
-        if (not (handled or isin(cmd_modes, get_mode(m.cmdline)))) {
-            insert(m.cmdline, c);
-            if ((get_mode(m.cmdline) == '/') and (len(*getall(m.menu)) < m.incremental_thresh)) {
-                m.keymap[10](m, m.menu, m.cmdline);
-            }
-            else if ((get_mode(m.cmdline) == '?') and (m.incremental_file)) {
-                m.keymap[10](m, m.menu, m.cmdline);
-            }
+        if (fds[1].revents != 0) {
+            finish_search(m);
+        }
+        update_input(m);
+
+        for (int c; (not m.quit) and ((c = wgetch(m.input_win)) != ERR);) {
+            handle_key(m, c);
         }
     }
 
@@ -1287,13 +3180,58 @@ auto show(Mew& m, const MenuData* menu_data = nullptr) -> void {
 }
 
 /**
+ * Get a view of all the input read so far.
 */
-auto get_initdata(const Mew& m) -> cvec<Item>* { return m.global_data; }
+auto get_initdata(const Mew& m) -> MenuData { return MenuData(m.global_data, get_size(*m.global_data)); }
 
 /**
 */
 auto get_initfiles(const Mew& m) -> cvec<str>* { return m.global_filenames; }
 
+/**
+ * Get the contents of the files given on the command line.
+ *
+ * The contents come from the file cache, so files are only read
+ * again if they changed before the search was started with '?'.
+*/
+auto get_initfiledata(Mew& m) -> FileData { return m.file_cache->get(*m.global_filenames); }
+
+/**
+ * Get the compressed stores of the files given on the command line,
+ * loading them the first time.
+ *
+ * @return the stores, or nothing if the files aren't searched
+ *      compressed.
+*/
+auto get_initcompressed(Mew& m) -> std::optional<CompressedData> {
+    if (m.compressed_files == nullptr) {
+        return std::nullopt;
+    }
+    return get_compressed(*m.compressed_files, *m.global_filenames);
+}
+
+/**
+ * Get the cache keys of the files given on the command line, without
+ * reading them.
+ *
+ * @return `(size, mtime)` of each file, or nothing for the files that
+ *      aren't cached.
+*/
+auto find_initfilekeys(const Mew& m) -> FileKeys {
+    auto files = FileKeys();
+    files.reserve(len(*m.global_filenames));
+    for (cstr& filename : *m.global_filenames) {
+        append(files, m.file_cache->find_key(filename));
+    }
+    return files;
+}
+
+/**
+ * Read the files given on the command line again by the next search
+ * if they changed since they were cached.
+*/
+auto refresh_initfiles(Mew& m) -> void { m.file_cache->refresh(); }
+
 /**
 */
 auto next_menu(Mew& m) -> const MenuHistoryElem* { return next(m.menu_history); }
@@ -1304,236 +3242,438 @@ auto insert_menu(Mew& m, MenuHistoryElem&& e) -> void {
 
 /**
 */
-auto next_cmd(Mew& m) -> const Item* { return next(m.cmd_history); }
-auto prev_cmd(Mew& m) -> const Item* { return prev(m.cmd_history); }
-auto insert_cmd(Mew& m, Item&& c) -> void {
+auto next_cmd(Mew& m) -> const str* { return next(m.cmd_history); }
+auto prev_cmd(Mew& m) -> const str* { return prev(m.cmd_history); }
+auto insert_cmd(Mew& m, str&& c) -> void {
     add_go_next(m.cmd_history, c);
 }
 /**
 */
-auto getall_cmd(const Mew& m) -> cvec<Item>* { return getall(m.cmd_history); }
+auto getall_cmd(const Mew& m) -> cvec<str>* { return getall(m.cmd_history); }
 
 /**
 */
-auto next_qry(Mew& m) -> const Item* { return next(m.search_history); }
-auto prev_qry(Mew& m) -> const Item* { return prev(m.search_history); }
-auto insert_qry(Mew& m, Item&& q) -> void {
+auto next_qry(Mew& m) -> const str* { return next(m.search_history); }
+auto prev_qry(Mew& m) -> const str* { return prev(m.search_history); }
+auto insert_qry(Mew& m, str&& q) -> void {
     add_go_next(m.search_history, q);
 }
 /**
 */
-auto getall_qry(const Mew& m) -> cvec<Item>* { return getall(m.search_history); }
+auto getall_qry(const Mew& m) -> cvec<str>* { return getall(m.search_history); }
 
 /**
+ * @return true if a search was cancelled (see `SearchWorker`).
 */
-auto fill_batch(vec2d<Item>& strings, std::istream& is, int batch_size, cstr& filename, long offset) -> long {
-    auto n_threads = len(strings);
-    auto line = str();
-    forall(strings, ::clear<vec<Item>>);
-    for (int count = 0; count < batch_size; ++count) {
-        for (int j = 0; j < n_threads; ++j) {
-            if (not std::getline(is, line)) {
-                return -1;
+auto is_cancelled(const std::atomic<bool>* cancel) -> bool {
+    return (cancel != nullptr) and cancel->load(std::memory_order_relaxed);
+}
+
+/**
+ * Find the items shown by `items` that may match a search, using the
+ * indexes of the arena of the viewed items.
+ *
+ * The `j`th item of the input is the `j`th line of its arena (see
+ * `add_text`), so the indexes can be used when all of the viewed items
+ * are in the arena and it is indexed, which is the case for the input
+ * once it is read.
+ *
+ * @param find function of the arena and its `lineindex::Indexes` that
+ *      returns the ids of the lines that may match in increasing
+ *      order, or nothing.
+ *
+ * @return positions in `items` of the items that may match, in order,
+ *      or nothing if all of them have to be searched.
+*/
+template<typename F>
+auto find_candidates(const MenuData& items, const lineindex::Indexer* indexer, F find) -> std::optional<vec<int>> {
+    if (indexer == nullptr) {
+        return std::nullopt;
+    }
+    const auto& lines = *get_items(items);
+    const auto& arena = get_arena(lines);
+    if (long(arena.size()) != get_size(lines)) {
+        return std::nullopt;
+    }
+    const auto candidates = find(arena, indexer->get(arena));
+    if (not candidates) {
+        return std::nullopt;
+    }
+
+    auto positions = vec<int>();
+    const auto* indices = get_indices(items);
+    if (indices == nullptr) {
+        for (const auto line : *candidates) {
+            if (long(line) >= get_size(items)) {
+                break;
             }
-            append(strings[j], Item(line, filename, offset));
-            ++offset;
+            append(positions, int(line));
         }
+        return positions;
     }
-    return offset;
+    for (int j = 0; j < get_size(items); ++j) {
+        if (std::ranges::binary_search(*candidates, std::uint32_t((*indices)[j]))) {
+            append(positions, j);
+        }
+    }
+    return positions;
 }
 
 /**
 */
-auto find_fuzzy_files(cvec<str>& filenames, cstr& pattern, bool parallel = false) -> MenuData {
-    auto search_args = qdata::SearchArgs{
-        .q=pattern,
-        .ignore_case=true,
-        .smart_case=true,
-        .topk=100,
-        .filenames=filenames,
-        .parallel=parallel,
-        .preserve_order=false,
-        .batch_size=10000,
-        .max_symbol_dist=10,
-        .gap_penalty="linear",
-        .word_delims=":;,./-_ \t",
-        .show_color=false,
-    };
-    auto scores = lz::search<scores::LinearScorer>(search_args);
-
-    auto file_matches = newVecReserve<Item>(len(scores));
-    auto attrs = newVecReserve<vec<ItemAttr>>(len(scores));
-    for (const auto& [score, match] : scores) {
-        append(file_matches, Item(match.text, match.filename, match.lineno));
+auto find_fuzzy_files(const FileData& files, cstr& pattern, bool parallel = false, const std::atomic<bool>* cancel = nullptr, const SearchProgress& progress = nullptr, const lineindex::Indexer* indexer = nullptr) -> MenuData {
+    auto search_args = make_search_args(pattern, parallel);
+    search_args.cancel = cancel;
+    search_args.indexer = indexer;
+
+    // Matches refer to files by name.
+    auto files_by_name = map<str, const std::shared_ptr<const linestore::LineStore>*>();
+    for (const auto& file : files) {
+        files_by_name.try_emplace(file->get_name(), &file);
+    }
 
-        auto cur_attrs = newVecReserve<ItemAttr>(len(score.path));
-        mapall(score.path, cur_attrs, mew::newItemAttr);
-        append(attrs, std::move(cur_attrs));
+    const auto highlighter = std::make_shared<Highlighter>(pattern, false);
+    const auto to_data = [&](const auto& scores) {
+        auto file_matches = Lines();
+        for (const auto& [score, match] : scores) {
+            // Line numbers of matches start at 1.
+            add_line(file_matches, *files_by_name.at(match.filename), match.lineno - 1);
+        }
+        return MenuData(std::move(file_matches), highlighter);
+    };
+    auto on_progress = lz::ProgressCallback();
+    if (progress) {
+        on_progress = [&](auto&& scores) { progress(to_data(scores)); };
     }
-    return {file_matches, attrs};
+    return to_data(lz::search<scores::LinearScorer>(search_args, files, on_progress));
 }
 
 /**
+ * Search compressed files (see `CompressedFiles`).
+ *
+ * The lines that match are extracted from the stores, so the results
+ * are copies of them (see `add_source_line`).
 */
-auto find_fuzzy(cvec<Item>& items, cstr& pattern, bool parallel = false) -> MenuData {
-    auto search_args = qdata::SearchArgs{
-        .q=pattern,
-        .ignore_case=true,
-        .smart_case=true,
-        .topk=100,
-        .filenames=vec<str>(),
-        .parallel=parallel,
-        .preserve_order=false,
-        .batch_size=10000,
-        .max_symbol_dist=10,
-        .gap_penalty="linear",
-        .word_delims=":;,./-_ \t",
-        .show_color=false,
+auto find_fuzzy_compressed(const CompressedData& files, cstr& pattern, bool parallel = false, const std::atomic<bool>* cancel = nullptr, const SearchProgress& progress = nullptr) -> MenuData {
+    auto search_args = make_search_args(pattern, parallel);
+    search_args.cancel = cancel;
+
+    const auto highlighter = std::make_shared<Highlighter>(pattern, false);
+    const auto to_data = [&](const auto& scores) {
+        auto matches = Lines();
+        for (const auto& [score, match] : scores) {
+            // Line numbers of matches start at 1.
+            add_source_line(matches, match.filename, match.lineno - 1, match.text);
+        }
+        return MenuData(std::move(matches), highlighter);
     };
-    auto lines = newVecReserve<str>(len(items));
-    mapall(items, lines, tostr);
-    auto scores = lz::search<scores::LinearScorer>(search_args, &lines);
+    auto on_progress = lz::ProgressCallback();
+    if (progress) {
+        on_progress = [&](auto&& scores) { progress(to_data(scores)); };
+    }
+    return to_data(lz::search<scores::LinearScorer>(search_args, files, on_progress));
+}
 
-    auto file_matches = newVecReserve<Item>(1);
-    auto attrs = newVecReserve<vec<ItemAttr>>(1);
-    for (const auto& [score, match] : scores) {
-        append(file_matches, Item(match.text, match.filename, match.lineno));
+/**
+ * Find the lines of the arena of `items` to search: the ones shown
+ * by `items` that the indexes leave.
+ *
+ * The `j`th item is the `j`th line of the arena when all of the items
+ * are in it (see `add_text`), so item indices are line ids.
+ *
+ * @return ids of the lines to search in increasing order, or nothing
+ *      if all of them have to be.
+*/
+auto find_arena_candidates(const MenuData& items, const std::optional<std::vector<std::uint32_t>>& indexed) -> std::optional<std::vector<std::uint32_t>> {
+    const auto& arena = get_arena(*get_items(items));
+    const auto* indices = get_indices(items);
+    if (indices == nullptr) {
+        if ((not indexed) and (long(arena.size()) == get_size(items))) {
+            return std::nullopt;
+        }
+        auto lines = indexed ? *indexed : std::vector<std::uint32_t>(get_size(items));
+        if (not indexed) {
+            std::iota(std::begin(lines), std::end(lines), 0);
+        }
+        lines.erase(std::ranges::lower_bound(lines, std::uint32_t(get_size(items))), std::end(lines));
+        return lines;
+    }
 
-        auto cur_attrs = newVecReserve<ItemAttr>(len(score.path));
-        mapall(score.path, cur_attrs, mew::newItemAttr);
-        append(attrs, std::move(cur_attrs));
+    auto lines = std::vector<std::uint32_t>(std::cbegin(*indices), std::cend(*indices));
+    std::ranges::sort(lines);
+    if (indexed) {
+        auto shown = std::move(lines);
+        lines.clear();
+        std::ranges::set_intersection(shown, *indexed, std::back_inserter(lines));
     }
-    return {file_matches, attrs};
+    return lines;
 }
 
 /**
+ * Search the items shown by `items`.
+ *
+ * When all of the items are in the arena (ie. for the input), the
+ * arena is searched in place, going through the lines shown that the
+ * indexes leave.  Otherwise the items are copied: items from files
+ * are only in the results of `?` searches, so there are few of them.
+ *
+ * @return a view of the matching items (the items are not copied).
 */
-auto find_regex_files(cvec<str>& filenames, cstr& pattern, bool parallel = false) -> MenuData {
-    if (parallel) {
-        return find_regex_files_parallel(filenames, pattern);
-    }
-
-    auto attrs = mew::LineAttrs();
-    auto file_matches = vec<Item>();
-    auto re = std::make_unique<re2::RE2>("(" + pattern + ")");
-    auto match = re2::StringPiece();
-    for (const auto& filename : filenames) {
-        auto is = std::ifstream(filename);
-        str line = "";
-        long lineno = -1;
-        while (std::getline(is, line)) {
-            ++lineno;
-            if (not RE2::PartialMatch(line, *re, &match)) {
-                continue;
+auto find_fuzzy(const MenuData& items, cstr& pattern, bool parallel = false, const std::atomic<bool>* cancel = nullptr, const SearchProgress& progress = nullptr, const lineindex::Indexer* indexer = nullptr) -> MenuData {
+    auto search_args = make_search_args(pattern, parallel);
+    search_args.cancel = cancel;
+
+    const auto highlighter = std::make_shared<Highlighter>(pattern, false);
+    const auto& lines = get_items(items);
+    const auto& arena = get_arena(*lines);
+    if (long(arena.size()) == get_size(*lines)) {
+        const auto query = qparse::getparse<scores::LinearScorer>(search_args);
+        const auto indexed = (indexer != nullptr) ? lineindex::find_candidates(arena, indexer->get(arena), *query.filter_tree, lz::get_fuzzy_terms(query)) : std::nullopt;
+        const auto candidates = find_arena_candidates(items, indexed);
+
+        // The store shares the ownership of the items.
+        const auto stores = vec<std::shared_ptr<const linestore::LineStore>>{std::shared_ptr<const linestore::LineStore>(lines, &arena)};
+        const auto to_data = [&](const auto& scores) {
+            auto indices = newVecReserve<int>(len(scores));
+            for (const auto& [score, match] : scores) {
+                // Line numbers of matches start at 1.
+                append(indices, int(match.lineno - 1));
             }
-            long unsigned int beg = match.data() - line.data();
-            attrs.push_back({mew::ItemAttr(beg, beg + len(match), COLOR_PAIR(2))});
-            //append(attrs, {mew::ItemAttr{beg, beg + len(match), COLOR_PAIR(2)}});
-            //attrs.push_back({mew::ItemAttr{beg, beg + len(match), A_REVERSE}});
-            file_matches.push_back(Item(line, filename, lineno));
-            //append(file_matches, {"", line, filename, lineno});
+            return MenuData(lines, std::move(indices), highlighter);
+        };
+        auto on_progress = lz::ProgressCallback();
+        if (progress) {
+            on_progress = [&](auto&& scores) { progress(to_data(scores)); };
+        }
+        return to_data(lz::search<scores::LinearScorer>(search_args, stores, {candidates}, on_progress));
+    }
+
+    auto texts = newVecReserve<str>(get_size(items));
+    for (int j = 0; j < get_size(items); ++j) {
+        if ((j % lz::cancel_interval == 0) and is_cancelled(cancel)) {
+            break;
+        }
+        append(texts, str(get_text(items, j)));
+    }
+
+    const auto to_data = [&](const auto& scores) {
+        auto indices = newVecReserve<int>(len(scores));
+        for (const auto& [score, match] : scores) {
+            // Line numbers of matches start at 1.
+            append(indices, get_index(items, match.lineno - 1));
+        }
+        return MenuData(lines, std::move(indices), highlighter);
+    };
+    auto on_progress = lz::ProgressCallback();
+    if (progress) {
+        on_progress = [&](auto&& scores) { progress(to_data(scores)); };
+    }
+    return to_data(lz::search<scores::LinearScorer>(search_args, texts, on_progress));
+}
+
+/**
+ * Search lines `[beg, end)` of a file for regex matches.
+ *
+ * @param candidates if not null, the lines searched are
+ *      `candidates[beg, end)` instead.
+ *
+ * @return indices of the matching lines.
+*/
+auto find_regex_lines(const linestore::LineStore& lines, long beg, long end, const re2::RE2& re, const std::atomic<bool>* cancel = nullptr, const std::vector<std::uint32_t>* candidates = nullptr) -> vec<long> {
+    auto file_matches = vec<long>();
+    for (long j = beg; j < end; ++j) {
+        if (((j - beg) % lz::cancel_interval == 0) and is_cancelled(cancel)) {
+            break;
+        }
+        const long lineno = (candidates != nullptr) ? long((*candidates)[j]) : j;
+        const auto line = lines.line(lineno);
+        if (RE2::PartialMatch(re2::StringPiece(line.data(), len(line)), re)) {
+            file_matches.push_back(lineno);
         }
-        is.close();
     }
-    return {file_matches, attrs};
+    return file_matches;
+}
+
+/**
+ * Find the lines of each file that may match a regex, using the
+ * indexes built so far.
+ *
+ * @return for each file, the ids of the lines to search, or nothing
+ *      if all of them have to be.
+*/
+auto find_regex_candidates(const FileData& files, cstr& pattern, const lineindex::Indexer* indexer) -> vec<std::optional<std::vector<std::uint32_t>>> {
+    auto candidates = vec<std::optional<std::vector<std::uint32_t>>>(len(files));
+    if (indexer == nullptr) {
+        return candidates;
+    }
+    for (std::size_t j = 0; j < len(files); ++j) {
+        candidates[j] = lineindex::find_regex_candidates(indexer->get(*files[j]), pattern);
+    }
+    return candidates;
 }
 
 /**
 */
-auto find_regex(cvec<Item>& items, cstr& pattern, bool parallel = false) -> MenuData {
+auto find_regex_files(const FileData& files, cstr& pattern, bool parallel = false, const std::atomic<bool>* cancel = nullptr, const lineindex::Indexer* indexer = nullptr) -> MenuData {
     if (parallel) {
-        return find_regex_parallel(items, pattern);
+        return find_regex_files_parallel(files, pattern, cancel, indexer);
     }
 
-    auto attrs = mew::LineAttrs();
-    auto matches = vec<Item>();
-    auto re = std::make_unique<re2::RE2>("(" + pattern + ")");
-    auto match = re2::StringPiece();
-    for (const auto& item : items) {
-        const auto line = *tostrp(item);
-        if (not RE2::PartialMatch(line, *re, &match)) {
-            continue;
+    auto file_matches = Lines();
+    auto re = std::make_unique<re2::RE2>(pattern);
+    const auto candidates = find_regex_candidates(files, pattern, indexer);
+    for (std::size_t j = 0; j < len(files); ++j) {
+        const auto& file = files[j];
+        const auto* file_candidates = candidates[j] ? &*candidates[j] : nullptr;
+        const long n_searched = file_candidates ? len(*file_candidates) : len(*file);
+        for (const auto line : find_regex_lines(*file, 0, n_searched, *re, cancel, file_candidates)) {
+            add_line(file_matches, file, line);
         }
-        long unsigned int beg = match.data() - line.data();
-        append(matches, Item(line, *get_filename(item), get_lineno(item)));
-        append(attrs, vec<mew::ItemAttr>{mew::ItemAttr(beg, beg + len(match), COLOR_PAIR(2))});
     }
-    return {matches, attrs};
+    return MenuData(std::move(file_matches), std::make_shared<Highlighter>(pattern, true));
 }
 
 /**
+ * Search compressed files (see `CompressedFiles`) for regex matches.
+ *
+ * The literals of the regex are looked up in the stores, and only the
+ * lines that have them are extracted and matched.  The files whose
+ * lines can't be narrowed down that way are read again and searched
+ * whole, without being cached.  Results are kept in file and line
+ * order, as copies of the lines (see `add_source_line`).
 */
-template<typename T>
-auto fill_batch(vec2d<T>& strings, cvec<T>& items, int batch_size, int offset) -> int {
-    auto n_items = len(items);
-    auto n_threads = len(strings);
-    forall(strings, ::clear<vec<T>>);
-    for (int count = 0; count < batch_size; ++count) {
-        for (int j = 0; j < n_threads; ++j) {
-            if (offset >= n_items) {
-                return offset;
+auto find_regex_compressed(const CompressedData& files, cstr& pattern, bool parallel = false, const std::atomic<bool>* cancel = nullptr) -> MenuData {
+    const unsigned int n_threads = parallel ? std::thread::hardware_concurrency() : 1;
+    auto re = std::make_unique<re2::RE2>(pattern);
+    auto matches = Lines();
+    for (const auto& file : files) {
+        if (is_cancelled(cancel)) {
+            break;
+        }
+        if (const auto candidates = lineindex::find_regex_candidates(*file, pattern); candidates) {
+            for (std::size_t j = 0; j < len(*candidates); ++j) {
+                if ((j % lz::cancel_interval == 0) and is_cancelled(cancel)) {
+                    break;
+                }
+                const auto line = file->line((*candidates)[j]);
+                if (RE2::PartialMatch(re2::StringPiece(line.data(), len(line)), *re)) {
+                    add_source_line(matches, file->get_name(), (*candidates)[j], line);
+                }
+            }
+            continue;
+        }
+        auto lines = linestore::LineStore(file->get_name());
+        if (linestore::load_file(file->get_name(), lines, n_threads)) {
+            for (const auto line : find_regex_lines(lines, 0, len(lines), *re, cancel)) {
+                add_source_line(matches, file->get_name(), line, lines.line(line));
             }
-            append(strings[j], items[offset]);
-            ++offset;
         }
     }
-    return offset;
+    return MenuData(std::move(matches), std::make_shared<Highlighter>(pattern, true));
 }
 
 /**
+ * Search the `[beg, end)` items shown by `items` for regex matches.
+ *
+ * @param positions if not null, the items searched are the ones shown
+ *      at `positions[beg, end)` instead.
+ *
+ * @return indices of the matching items in the viewed items.
 */
-auto find_regex_parallel(cvec<Item>& items, cstr& pattern) -> MenuData {
-    unsigned int n_threads = std::thread::hardware_concurrency();
-    auto results = vec2d<MenuData>(n_threads);
-    auto batch = vec2d<Item>(n_threads);
-    auto thread_indices = range(n_threads);
-
-    int n_items_read = 0;
-    for (bool stop = false; not stop;) {
-        n_items_read = fill_batch(batch, items, 10000, n_items_read);
-        stop = n_items_read >= len(items);
-        pforall(thread_indices, [&](auto k) {
-                append(results[k], find_regex(batch[k], pattern));
-                });
-    }
-    auto lines = vec<Item>();
-    auto attrs = mew::LineAttrs();
-    for (auto& mdv : results) {
-        for (auto& [cur_lines, cur_attrs] : mdv) {
-            concat(lines, std::move(cur_lines));
-            concat(attrs, std::move(cur_attrs));
+auto find_regex_items(const MenuData& items, int beg, int end, const re2::RE2& re, const std::atomic<bool>* cancel = nullptr, cvec<int>* positions = nullptr) -> vec<int> {
+    auto indices = vec<int>();
+    for (int j = beg; j < end; ++j) {
+        if (((j - beg) % lz::cancel_interval == 0) and is_cancelled(cancel)) {
+            break;
+        }
+        const int k = (positions != nullptr) ? (*positions)[j] : j;
+        const auto line = get_text(items, k);
+        if (RE2::PartialMatch(re2::StringPiece(line.data(), len(line)), re)) {
+            append(indices, get_index(items, k));
         }
     }
-    return {lines, attrs};
+    return indices;
+}
+
+/**
+ * Search the items shown by `items` for regex matches.
+ *
+ * @return a view of the matching items (the items are not copied).
+*/
+auto find_regex(const MenuData& items, cstr& pattern, bool parallel = false, const std::atomic<bool>* cancel = nullptr, const lineindex::Indexer* indexer = nullptr) -> MenuData {
+    if (parallel) {
+        return find_regex_parallel(items, pattern, cancel, indexer);
+    }
+
+    auto re = std::make_unique<re2::RE2>(pattern);
+    const auto positions = find_candidates(items, indexer, [&](const auto& arena, const auto& indexes) {
+            return lineindex::find_regex_candidates(indexes, pattern);
+            });
+    const int n_searched = positions ? len(*positions) : get_size(items);
+    auto indices = find_regex_items(items, 0, n_searched, *re, cancel, positions ? &*positions : nullptr);
+    return MenuData(get_items(items), std::move(indices), std::make_shared<Highlighter>(pattern, true));
+}
+
+/**
+ * Search the items shown by `items` for regex matches using all
+ * threads.
+ *
+ * The items are split into chunks (see `scheduler::make_units`).
+ * Results are kept in the order of the items.
+*/
+auto find_regex_parallel(const MenuData& items, cstr& pattern, const std::atomic<bool>* cancel, const lineindex::Indexer* indexer) -> MenuData {
+    unsigned int n_threads = std::thread::hardware_concurrency();
+    auto re = std::make_unique<re2::RE2>(pattern);
+
+    const auto positions = find_candidates(items, indexer, [&](const auto& arena, const auto& indexes) {
+            return lineindex::find_regex_candidates(indexes, pattern);
+            });
+    const int n_searched = positions ? len(*positions) : get_size(items);
+    const auto units = scheduler::make_units({std::size_t(n_searched)}, 10000);
+    auto results = vec<vec<int>>(len(units));
+    scheduler::run(len(units), n_threads, [&](auto worker, auto j) {
+            results[j] = find_regex_items(items, units[j].beg, units[j].end, *re, cancel, positions ? &*positions : nullptr);
+            });
+
+    auto indices = vec<int>();
+    for (auto& cur_indices : results) {
+        concat(indices, std::move(cur_indices));
+    }
+    return MenuData(get_items(items), std::move(indices), std::make_shared<Highlighter>(pattern, true));
 }
 
 /**
+ * Search files for regex matches using all threads.
+ *
+ * Small files are searched whole by one worker each and large files
+ * are split into chunks (see `scheduler::make_units`).  Results are
+ * kept in file and line order.
 */
-auto find_regex_files_parallel(cvec<str>& filenames, cstr& pattern) -> MenuData {
+auto find_regex_files_parallel(const FileData& files, cstr& pattern, const std::atomic<bool>* cancel, const lineindex::Indexer* indexer) -> MenuData {
     unsigned int n_threads = std::thread::hardware_concurrency();
-    auto results = vec2d<MenuData>(n_threads);
-    auto batch = vec2d<Item>(n_threads);
-    auto thread_indices = range(n_threads);
+    auto re = std::make_unique<re2::RE2>(pattern);
 
-    for (const auto& filename : filenames) {
-        auto is = std::ifstream(filename);
-        for (long n_items_read = 0; n_items_read > -1;) {
-            n_items_read = fill_batch(batch, is, 10000, filename, n_items_read);
-            pforall(thread_indices, [&](auto k) {
-                    append(results[k], find_regex(batch[k], pattern));
-                    });
-        }
-        is.close();
+    // Files with candidates are split by candidate rather than by line.
+    const auto candidates = find_regex_candidates(files, pattern, indexer);
+    auto sizes = newVecReserve<std::size_t>(len(files));
+    for (std::size_t j = 0; j < len(files); ++j) {
+        append(sizes, candidates[j] ? len(*candidates[j]) : len(*files[j]));
     }
-    auto lines = vec<Item>();
-    auto attrs = mew::LineAttrs();
-    for (auto& mdv : results) {
-        for (auto& [cur_lines, cur_attrs] : mdv) {
-            concat(lines, std::move(cur_lines));
-            concat(attrs, std::move(cur_attrs));
+    const auto units = scheduler::make_units(sizes, 10000);
+    auto results = vec<vec<long>>(len(units));
+    scheduler::run(len(units), n_threads, [&](auto worker, auto j) {
+            const auto& unit = units[j];
+            const auto& file_candidates = candidates[unit.source];
+            results[j] = find_regex_lines(*files[unit.source], unit.beg, unit.end, *re, cancel, file_candidates ? &*file_candidates : nullptr);
+            });
+
+    auto lines = Lines();
+    for (std::size_t j = 0; j < len(units); ++j) {
+        for (const auto line : results[j]) {
+            add_line(lines, files[units[j].source], line);
         }
     }
-    return {lines, attrs};
+    return MenuData(std::move(lines), std::make_shared<Highlighter>(pattern, true));
 }
 
 /**
@@ -1569,6 +3709,7 @@ auto create_keymap(cmap<int, KeyCommand>& user_keymap, cmap<int, int>& remap, bo
         return true;
     };
     keymap[27] = [&](Mew& mew, Menu& menu, CommandLine& cmdline) {
+        clear_search_base(mew);
         set_mode(cmdline, 's');
         return true;
     };
@@ -1634,6 +3775,9 @@ auto create_keymap(cmap<int, KeyCommand>& user_keymap, cmap<int, int>& remap, bo
     keymap[KEY_BACKSPACE] = [&](Mew& mew, Menu& menu, CommandLine& cmdline) {
         if (isin(cmd_modes, get_mode(cmdline))) return false;
         erase(cmdline);
+        if (get_mode(cmdline) == '/') {
+            restore_results(mew);
+        }
         return true;
     };
     keymap['q'] = [&](Mew& mew, Menu& menu, CommandLine& cmdline) {
@@ -1660,6 +3804,7 @@ auto create_keymap(cmap<int, KeyCommand>& user_keymap, cmap<int, int>& remap, bo
     };
     keymap['?'] = [&](Mew& mew, Menu& menu, CommandLine& cmdline) {
         if (not isin(cmd_modes, get_mode(cmdline))) return false;
+        refresh_initfiles(mew);
         set_mode(cmdline, '?');
         return true;
     };
@@ -1667,8 +3812,7 @@ auto create_keymap(cmap<int, KeyCommand>& user_keymap, cmap<int, int>& remap, bo
     keymap['L'] = [&](Mew& mew, Menu& menu, CommandLine& cmdline) {
         if (not isin(cmd_modes, get_mode(cmdline))) return false;
         if (auto mh = next_menu(mew); mh != nullptr) {
-            const auto& [items, attrs] = *get_data(*mh);
-            setall(menu, items, attrs);
+            setall(menu, get_data(*mh));
             set_text(cmdline, *get_text(*mh));
         }
         return true;
@@ -1676,12 +3820,26 @@ auto create_keymap(cmap<int, KeyCommand>& user_keymap, cmap<int, int>& remap, bo
     keymap['H'] = [&](Mew& mew, Menu& menu, CommandLine& cmdline) {
         if (not isin(cmd_modes, get_mode(cmdline))) return false;
         if (auto mh = prev_menu(mew); mh != nullptr) {
-            const auto& [items, attrs] = *get_data(*mh);
-            setall(menu, items, attrs);
+            setall(menu, get_data(*mh));
             set_text(cmdline, *get_text(*mh));
         }
         return true;
     };
+    keymap['A'] = [&](Mew& mew, Menu& menu, CommandLine& cmdline) {
+        if (not isin(cmd_modes, get_mode(cmdline))) return false;
+        select_all(menu, true);
+        return true;
+    };
+    keymap['U'] = [&](Mew& mew, Menu& menu, CommandLine& cmdline) {
+        if (not isin(cmd_modes, get_mode(cmdline))) return false;
+        select_all(menu, false);
+        return true;
+    };
+    keymap['V'] = [&](Mew& mew, Menu& menu, CommandLine& cmdline) {
+        if (not isin(cmd_modes, get_mode(cmdline))) return false;
+        invert_selection(menu);
+        return true;
+    };
     keymap['C'] = [&](Mew& mew, Menu& menu, CommandLine& cmdline) {
         if (get_mode(cmdline) != 's') return false;
         toggle_info(menu);
@@ -1690,7 +3848,7 @@ auto create_keymap(cmap<int, KeyCommand>& user_keymap, cmap<int, int>& remap, bo
     keymap['F'] = [&](Mew& mew, Menu& menu, CommandLine& cmdline) {
         if (get_mode(cmdline) != 's') return false;
         if (auto h = getall_cmd(mew); not std::empty(*h)) {
-            setall(menu, *h, {});
+            setall(menu, MenuData(to_lines(*h), {}));
         }
         set_mode(cmdline, 'F');
         return true;
@@ -1698,54 +3856,55 @@ auto create_keymap(cmap<int, KeyCommand>& user_keymap, cmap<int, int>& remap, bo
     keymap['f'] = [&](Mew& mew, Menu& menu, CommandLine& cmdline) {
         if (get_mode(cmdline) != 's') return false;
         if (auto h = getall_qry(mew); not std::empty(*h)) {
-            setall(menu, *h, {});
+            setall(menu, MenuData(to_lines(*h), {}));
         }
         set_mode(cmdline, 'f');
         return true;
     };
     keymap[10] = [parallel](Mew& mew, Menu& menu, CommandLine& cmdline) {
         if (auto mode = get_mode(cmdline); (mode == '/') or (mode == '?')) {
-            MenuData md;
+            // The search runs in the background (see `start_search`),
+            // so it gets copies of what it needs.
             const auto cmd_text = get_text(cmdline);
-            if (auto items = getall(menu); mode == '/') {
-                if (cmd_text[0] == '/') {
-                    md = find_regex(*items, cmd_text.substr(1), parallel);
-                }
-                else {
-                    md = find_fuzzy(*items, cmd_text, parallel);
-                }
+            const bool regex = (cmd_text[0] == '/');
+            const auto pattern = regex ? cmd_text.substr(1) : cmd_text;
+            auto corpus = std::optional<MenuData>();
+            if (mode == '/') {
+                corpus = get_search_base(mew, menu);
             }
             else if (std::empty(*get_initfiles(mew))) {
-                if (cmd_text[0] == '/') {
-                    md = find_regex(*get_initdata(mew), cmd_text.substr(1), parallel);
-                }
-                else {
-                    md = find_fuzzy(*get_initdata(mew), cmd_text, parallel);
-                }
+                corpus = get_initdata(mew);
             }
-            else {
-                if (cmd_text[0] == '/') {
-                    md = find_regex_files(*get_initfiles(mew), cmd_text.substr(1), parallel);
-                }
-                else {
-                    md = find_fuzzy_files(*get_initfiles(mew), cmd_text, parallel);
-                }
+
+            insert_qry(mew, mode + cmd_text);
+            auto key = make_result_key(mode, cmd_text, corpus, corpus ? FileKeys() : find_initfilekeys(mew));
+            if (show_cached_results(mew, cmd_text, key)) {
+                return true;
+            }
+
+            auto search = SearchFn();
+            long n_items = 0;
+            const auto* indexer = get_indexer(mew);
+            if (corpus) {
+                n_items = get_size(*corpus);
+                search = [items = *corpus, pattern, regex, parallel, indexer](const auto& cancel, const auto& progress) {
+                    return regex ? find_regex(items, pattern, parallel, &cancel, indexer) : find_fuzzy(items, pattern, parallel, &cancel, progress, indexer);
+                };
             }
-            const auto& [new_items, attrs] = md;
-
-            if (not std::empty(new_items)) {
-                setall(menu, new_items, attrs);
-                auto menu_hist_elem = MenuHistoryElem(
-                    std::make_tuple(std::move(new_items), std::move(attrs)),
-                    cmd_text
-                );
-               insert_menu(mew, std::move(menu_hist_elem));
+            else {
+                search = [&mew, pattern, regex, parallel, indexer](const auto& cancel, const auto& progress) {
+                    if (auto compressed = get_initcompressed(mew); compressed) {
+                        return regex ? find_regex_compressed(*compressed, pattern, parallel, &cancel) : find_fuzzy_compressed(*compressed, pattern, parallel, &cancel, progress);
+                    }
+                    const auto files = get_initfiledata(mew);
+                    return regex ? find_regex_files(files, pattern, parallel, &cancel, indexer) : find_fuzzy_files(files, pattern, parallel, &cancel, progress, indexer);
+                };
             }
-            insert_qry(mew, Item(mode + cmd_text));
+            start_search(mew, std::move(search), cmd_text, std::move(key), n_items);
             return true;
         }
         else if (auto mode = get_mode(cmdline); (mode == 'f')) {
-            if (current(menu) == nullptr) return true;
+            if (not current(menu)) return true;
             auto text = *current(menu);
             set_text(cmdline, str(std::begin(text) + 1, std::end(text)));
             set_mode(cmdline, text[0]);
@@ -1754,7 +3913,7 @@ auto create_keymap(cmap<int, KeyCommand>& user_keymap, cmap<int, int>& remap, bo
         }
         else if (auto mode = get_mode(cmdline); (mode == 'F')) {
             // TODO: this is the same as `c`.
-            if (current(menu) == nullptr) return true;
+            if (not current(menu)) return true;
             auto text = *current(menu);
             set_text(cmdline, str(std::begin(text) + 1, std::end(text)));
             set_mode(cmdline, text[0]);
@@ -1765,14 +3924,14 @@ auto create_keymap(cmap<int, KeyCommand>& user_keymap, cmap<int, int>& remap, bo
             set_mode(cmdline, 's');
             make_populatemenu_cmd(get_text(cmdline))(mew, menu, cmdline);
             set_mode(cmdline, 'X');
-            insert_cmd(mew, Item('X' + get_text(cmdline)));
+            insert_cmd(mew, 'X' + get_text(cmdline));
             return true;
         }
         else if (auto mode = get_mode(cmdline); (mode == 'x')) {
             set_mode(cmdline, 's');
             make_interactive_cmd(get_text(cmdline))(mew, menu, cmdline);
             set_mode(cmdline, 'x');
-            insert_cmd(mew, Item('x' + get_text(cmdline)));
+            insert_cmd(mew, 'x' + get_text(cmdline));
             return true;
         }
         return false;
@@ -1855,10 +4014,10 @@ auto replace_unescaped(cstr& line, const Menu& menu) -> str {
         if (we[j - 1].back() == '%') {
             joined_str += we[j];
         }
-        else if ((we[j][0] == 'h') && (current(menu) != nullptr)) {
+        else if ((we[j][0] == 'h') && current(menu)) {
             if (std::empty(hrepp)) {
                 hrepp = " '"
-                    + join(split(*current(menu), '\''),  str("'\\''"))
+                    + join(split(str(*current(menu)), '\''),  str("'\\''"))
                     + "' ";
             }
             joined_str += hrepp + we[j].substr(1);
@@ -1875,9 +4034,10 @@ auto replace_unescaped(cstr& line, const Menu& menu) -> str {
         }
         else if (we[j][0] == 'a') {
             if (std::empty(arepp)) {
-                for (const auto& item : *getall(menu)) {
+                const auto& items = *getall(menu);
+                for (int k = 0; k < get_size(items); ++k) {
                     arepp += " '"
-                        + join(split(*get_text(item), '\''),  str("'\\''"))
+                        + join(split(str(get_text(items, k)), '\''),  str("'\\''"))
                         + "' ";
                 }
             }
@@ -1927,20 +4087,18 @@ auto make_populatemenu_cmd(str cmd) -> KeyCommand {
 
         int n_bytes = 1 << 10;
         char line[n_bytes];
-        auto lines = vec<Item>();
+        auto lines = Lines();
         while (fgets(line, n_bytes, fd) != NULL) {
             auto line_len = len(line);
             auto n_chars = line[line_len - 1] == '\n' ? line_len - 1 : line_len;
-            append(lines, mew::newItem(str(line, n_chars)));
+            add_text(lines, std::string_view(line, n_chars));
         }
         int status = pclose(fd);
 
-        if (not std::empty(lines)) {
-            setall(menu, lines, {});
-            auto menu_hist_elem = MenuHistoryElem(
-                std::make_tuple(std::move(lines), mew::LineAttrs()),
-                get_text(cmdline)
-            );
+        if (get_size(lines) > 0) {
+            auto md = MenuData(std::move(lines), {});
+            setall(menu, md);
+            auto menu_hist_elem = MenuHistoryElem(md, get_text(cmdline));
             insert_menu(mew, std::move(menu_hist_elem));
         }
         return true;
@@ -1951,20 +4109,13 @@ auto make_populatemenu_cmd(str cmd) -> KeyCommand {
 
 /**
 */
-auto get_filenames_from_stdin() -> vec<str> {
+auto get_filenames_from_stdin(char delim) -> vec<str> {
     auto lines = vec<str>();
-    mapall(std::cin, lines, identity<str>);
+    auto reader = linestore::BlockReader(STDIN_FILENO, delim);
+    mapall(reader, lines, identity<str>);
     return lines;
 }
 
-/**
-*/
-auto get_input_from_stdin() -> mew::MenuData {
-    auto lines = vec<mew::Item>();
-    mapall(std::cin, lines, mew::newItem);
-    return {lines, mew::LineAttrs()};
-}
-
 /**
 */
 auto read_config(cstr& filename) -> std::tuple<map<int, mew::KeyCommand>, map<int, int>> {
@@ -2025,31 +4176,55 @@ struct CmdLineArgs {
     vec<str> filenames;
     int incremental_thresh;
     bool incremental_file;
+    int latency_budget;
     bool parallel;
     str config;
     bool stdin_files;
+    bool read0;
+    str snapshot;
+    bool index;
+    bool suffix_index;
+    bool word_index;
+    bool pair_index;
+    bool compressed;
 };
 
 auto get_cmdline_args(int argc, char* argv[]) -> CmdLineArgs {
     auto cmdline_args = CmdLineArgs{
         .filenames=vec<str>(),
-        .incremental_thresh=500000,
+        .incremental_thresh=-1,
         .incremental_file=false,
+        .latency_budget=int(mew::default_latency_budget.count()),
         .parallel=false,
         .config="",
         .stdin_files=false,
+        .read0=false,
+        .snapshot="",
+        .index=false,
+        .suffix_index=false,
+        .word_index=false,
+        .pair_index=false,
+        .compressed=false,
     };
 
-    const auto shortopts = "fpTt:c:";
-    const int STDIN_FILES='f', CONFIG='c', PARALLEL='p', INCREMENTAL_FILE='T', INCREMENTAL_THRESH='t';
+    const auto shortopts = "fpTt:b:c:0S:IAWPZ";
+    const int STDIN_FILES='f', CONFIG='c', PARALLEL='p', INCREMENTAL_FILE='T', INCREMENTAL_THRESH='t', LATENCY_BUDGET='b', READ0='0', SNAPSHOT='S', INDEX='I', SUFFIX_INDEX='A', WORD_INDEX='W', PAIR_INDEX='P', COMPRESSED='Z';
 
     int opt_idx;
     option longopts[] = {
         option{.name="incremental-thresh", .has_arg=required_argument, .flag=0, .val=INCREMENTAL_THRESH},
         option{.name="incremental-file", .has_arg=no_argument, .flag=0, .val=INCREMENTAL_FILE},
+        option{.name="latency-budget", .has_arg=required_argument, .flag=0, .val=LATENCY_BUDGET},
         option{.name="parallel", .has_arg=no_argument, .flag=0, .val=PARALLEL},
         option{.name="config", .has_arg=required_argument, .flag=0, .val=CONFIG},
         option{.name="stdin-files", .has_arg=no_argument, .flag=0, .val=STDIN_FILES},
+        option{.name="read0", .has_arg=no_argument, .flag=0, .val=READ0},
+        option{.name="snapshot", .has_arg=required_argument, .flag=0, .val=SNAPSHOT},
+        option{.name="index", .has_arg=no_argument, .flag=0, .val=INDEX},
+        option{.name="suffix-index", .has_arg=no_argument, .flag=0, .val=SUFFIX_INDEX},
+        option{.name="word-index", .has_arg=no_argument, .flag=0, .val=WORD_INDEX},
+        option{.name="pair-index", .has_arg=no_argument, .flag=0, .val=PAIR_INDEX},
+        option{.name="compressed", .has_arg=no_argument, .flag=0, .val=COMPRESSED},
         option{.name=0, .has_arg=0, .flag=0, .val=0},
     };
 
@@ -2067,6 +4242,9 @@ auto get_cmdline_args(int argc, char* argv[]) -> CmdLineArgs {
             case INCREMENTAL_THRESH:
                 cmdline_args.incremental_thresh = std::atoi(optarg);
                 break;
+            case LATENCY_BUDGET:
+                cmdline_args.latency_budget = std::atoi(optarg);
+                break;
             case PARALLEL:
                 cmdline_args.parallel = true;
                 break;
@@ -2076,6 +4254,27 @@ auto get_cmdline_args(int argc, char* argv[]) -> CmdLineArgs {
             case STDIN_FILES:
                 cmdline_args.stdin_files = true;
                 break;
+            case READ0:
+                cmdline_args.read0 = true;
+                break;
+            case SNAPSHOT:
+                cmdline_args.snapshot = optarg;
+                break;
+            case INDEX:
+                cmdline_args.index = true;
+                break;
+            case SUFFIX_INDEX:
+                cmdline_args.suffix_index = true;
+                break;
+            case WORD_INDEX:
+                cmdline_args.word_index = true;
+                break;
+            case PAIR_INDEX:
+                cmdline_args.pair_index = true;
+                break;
+            case COMPRESSED:
+                cmdline_args.compressed = true;
+                break;
         }
     }
 
@@ -2087,44 +4286,113 @@ auto get_cmdline_args(int argc, char* argv[]) -> CmdLineArgs {
     }
 
     if (cmdline_args.stdin_files) {
-        concat(cmdline_args.filenames, get_filenames_from_stdin());
+        concat(cmdline_args.filenames, get_filenames_from_stdin(cmdline_args.read0 ? '\0' : '\n'));
     }
 
     return cmdline_args;
 }
 
-/**
-*/
-template<typename T>
-auto print(const T& t) -> void {
-    std::cout << t << std::endl;
-}
-
 auto main(int argc, char *argv[]) -> int {
     setlocale(LC_ALL, ""); // utf8 support.
 
     const auto args = get_cmdline_args(argc, argv);
     auto [keymap, remap] = read_config(args.config);
 
-    auto menu_data = mew::MenuData();
-    auto data = vec<mew::Item>();
+    // Read stdin in the background so that the menu is shown right
+    // away.  The descriptor is duplicated since ncurses reopens stdin
+    // on the terminal.
+    //
+    // With a snapshot, the input of the run that wrote it is mapped
+    // instead when nothing is piped in, and the files given that
+    // haven't changed since it was written are not read again.
+    // Otherwise the snapshot is written once the input is read.  The
+    // snapshot only holds lines, so indexes (see below) are built
+    // again from the mapped lines on each run.
+    //
+    // With indexes, the input and files are indexed in the background
+    // as soon as they are read (or mapped), and searches use what is
+    // indexed so far.
+    //
+    // With compressed files, `?` searches go through compressed stores
+    // of the files, loaded by the first one, and the files are neither
+    // prefetched nor kept in the snapshot.
+    auto data = std::make_shared<mew::Lines>();
+    auto input = std::unique_ptr<mew::InputReader>();
+    const unsigned int n_threads = args.parallel ? std::thread::hardware_concurrency() : 1;
+    auto indexer = (args.index or args.suffix_index or args.word_index or args.pair_index) ? std::make_unique<lineindex::Indexer>(n_threads, args.index, args.suffix_index, args.word_index ? mew::word_delims : "", args.pair_index) : nullptr;
+    auto file_cache = filecache::FileCache(n_threads);
+    auto compressed_files = args.compressed ? std::make_unique<mew::CompressedFiles>(n_threads) : nullptr;
+    if (indexer) {
+        file_cache.set_on_load([&indexer](const auto& lines) { indexer->add(lines); });
+    }
+    bool save_snapshot = (not std::empty(args.snapshot)) and not (args.compressed and not std::empty(args.filenames));
     if (std::empty(args.filenames)) {
-        menu_data = get_input_from_stdin();
-        data = std::get<0>(menu_data);
+        auto entries = (save_snapshot and isatty(STDIN_FILENO)) ? snapshot::load(args.snapshot) : std::nullopt;
+        if (entries and (len(*entries) == 1) and std::empty((*entries)[0].lines->get_name())) {
+            load_text(*data, *(*entries)[0].lines);
+            save_snapshot = false;
+        }
+        else {
+            input = std::make_unique<mew::InputReader>(dup(STDIN_FILENO), args.read0 ? '\0' : '\n');
+        }
+    }
+    else if (save_snapshot) {
+        if (auto entries = snapshot::load(args.snapshot); entries) {
+            // Stores of files changed or not given since the snapshot
+            // was written would only be indexed for nothing.
+            const auto given = std::unordered_set<str>(std::begin(args.filenames), std::end(args.filenames));
+            for (auto& entry : *entries) {
+                auto filename = entry.lines->get_name();
+                if (given.contains(filename) and filecache::is_current(filename, entry)) {
+                    file_cache.add(filename, std::move(entry));
+                }
+            }
+        }
+        save_snapshot = not std::ranges::all_of(args.filenames, [&](cstr& filename) { return file_cache.is_current(filename); });
+    }
+
+    // Read the files in the background so that `?` searches don't
+    // have to read them again.
+    if (not args.compressed) {
+        file_cache.prefetch(args.filenames);
     }
 
     auto mew = mew::Mew(
             std::move(keymap),
             std::move(remap),
-            &data,
+            data,
             &args.filenames,
+            &file_cache,
+            compressed_files.get(),
+            indexer.get(),
+            input.get(),
             args.incremental_thresh,
             args.incremental_file,
-            args.parallel);
-    show(mew, std::empty(args.filenames) ? &menu_data : nullptr);
-    forall(get_selections(mew), print<str>);
+            args.parallel,
+            std::chrono::milliseconds(args.latency_budget));
+    if (std::empty(args.filenames) and (input == nullptr)) {
+        index_input(mew);
+        const auto initdata = get_initdata(mew);
+        show(mew, &initdata);
+    }
+    else {
+        show(mew);
+    }
+    bool ok = write_selections(mew, STDOUT_FILENO);
+
+    if (save_snapshot and std::empty(args.filenames) and is_input_done(mew)) {
+        const auto text = std::shared_ptr<const linestore::LineStore>(data, &get_arena(*data));
+        snapshot::save(args.snapshot, {filecache::Entry{.size=-1, .mtime=-1, .lines=text}});
+    }
+    else if (save_snapshot and not std::empty(args.filenames)) {
+        auto entries = vec<filecache::Entry>();
+        for (const auto& filename : args.filenames) {
+            append(entries, file_cache.get_entry(filename));
+        }
+        snapshot::save(args.snapshot, entries);
+    }
 
-    return 0;
+    return ok ? 0 : 1;
 }
 
 //let create_keymap λ: () → (ℤ map (λ: (Mew&, Menu&, CommandLine&) → 𝔹));